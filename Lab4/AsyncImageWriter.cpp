@@ -0,0 +1,106 @@
+#include "AsyncImageWriter.h"
+
+#include <iostream>
+
+using namespace cimg_library;
+
+
+void QuantizeImage(const CImg<float>& img, float mn, float mx,
+                   CImg<unsigned char>& to_disk)
+{
+    to_disk.assign(img.dimx(), img.dimy());
+    //  a constant image is written black instead of dividing by zero
+    float factor = mx > mn ? 255/(mx - mn) : 0;
+
+    const float *src = img.ptr();
+    unsigned char *dst = to_disk.ptr();
+    unsigned long n = to_disk.size();
+    for(unsigned long i = 0; i < n; i++)
+        dst[i] = static_cast<unsigned char>((src[i] - mn)*factor);
+}
+
+
+AsyncImageWriter::AsyncImageWriter(unsigned int capacity)
+    : m_capacity(capacity > 0 ? capacity : 1), m_busy(0), m_stop(false)
+{
+    m_thread = std::thread(&AsyncImageWriter::Run, this);
+}
+
+
+AsyncImageWriter::~AsyncImageWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_not_empty.notify_all();
+    m_thread.join();
+}
+
+
+void AsyncImageWriter::Write(const CImg<float>& img, float mn, float mx,
+                             const std::string& fn)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(m_queue.size() >= m_capacity)
+        m_not_full.wait(lock);
+
+    //  the copy constructor keeps shared images shared
+    m_queue.emplace_back(img, mn, mx, fn);
+
+    lock.unlock();
+    m_not_empty.notify_one();
+}
+
+
+void AsyncImageWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_queue.empty() || m_busy > 0)
+        m_not_full.wait(lock);
+}
+
+
+void AsyncImageWriter::Run()
+{
+    CImg<unsigned char> to_disk;
+    for(;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(m_queue.empty() && !m_stop)
+                m_not_empty.wait(lock);
+            //  the queue is emptied before stopping
+            if(m_queue.empty())
+                return;
+            Job& front = m_queue.front();
+            job.img.swap(front.img);
+            job.mn = front.mn;
+            job.mx = front.mx;
+            job.fn.swap(front.fn);
+            m_queue.pop_front();
+            m_busy++;
+        }
+        m_not_full.notify_all();
+
+        QuantizeImage(job.img, job.mn, job.mx, to_disk);
+        std::cout << "Writing file: " << job.fn << std::endl;
+        try
+        {
+            to_disk.save(job.fn.c_str());
+        }
+        catch(CImgException& e)
+        {
+            //  an exception cannot leave the thread, the other images are
+            //  still written
+            std::cerr << e.message << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy--;
+        }
+        m_not_full.notify_all();
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef ASYNC_IMAGE_WRITER_H  //  This prevents including the same file twice
+#define ASYNC_IMAGE_WRITER_H
+
+#include "CImg.h" //relative path of the CImg file
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*!
+ * \brief Quantize an image to [0-255] given its range, in one row-major pass
+ * \param img      the image
+ * \param mn, mx   the range of the values of img
+ * \param to_disk  the quantized image (output)
+ */
+void QuantizeImage(const cimg_library::CImg<float>& img, float mn, float mx,
+                   cimg_library::CImg<unsigned char>& to_disk);
+
+/*!
+ * \class AsyncImageWriter "AsyncImageWriter.h"
+ * \brief Quantize images to 8 bits and write them to the disk from a
+ * background thread.
+ *
+ * Write() pushes an image on a bounded queue and returns at once, unless
+ * the queue is full, so that the caller can compute the next image while
+ * the previous ones are encoded and written.
+ */
+class AsyncImageWriter
+{
+public:
+    /*!
+     * \brief constructor, starts the writer thread
+     * \param capacity  maximal number of images waiting to be written
+     */
+    AsyncImageWriter(unsigned int capacity = 4);
+
+    /*!
+     * \brief destructor, writes the remaining images and stops the thread
+     */
+    ~AsyncImageWriter();
+
+    /*!
+     * \brief queue an image to be written
+     *
+     * The image is copied, unless it is a shared image (e.g. a plane
+     * returned by get_shared_plane()): its memory must then remain valid
+     * until Flush() returns.
+     * \param img      the image
+     * \param mn, mx   the range of the values of img
+     * \param fn       the file name
+     */
+    void Write(const cimg_library::CImg<float>& img, float mn, float mx,
+               const std::string& fn);
+
+    /*!
+     * \brief wait until all the queued images are written
+     */
+    void Flush();
+
+private:
+    //! an image waiting to be written
+    struct Job
+    {
+        Job() : mn(0), mx(0) {}
+        Job(const cimg_library::CImg<float>& _img, float _mn, float _mx,
+            const std::string& _fn) : img(_img), mn(_mn), mx(_mx), fn(_fn) {}
+
+        cimg_library::CImg<float> img;
+        float mn, mx;
+        std::string fn;
+    };
+
+    //! loop of the writer thread
+    void Run();
+
+    AsyncImageWriter(const AsyncImageWriter&);
+    AsyncImageWriter& operator=(const AsyncImageWriter&);
+
+    unsigned int m_capacity;
+    std::deque<Job> m_queue;
+    unsigned int m_busy;        ///< number of jobs being written
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::thread m_thread;
+};
+
+#endif // ASYNC_IMAGE_WRITER_H
@@ -1,4 +1,5 @@
 #include "CImg.h" //relative path of the CImg file
+#include "AsyncImageWriter.h"
 
 /* the namespace permits to use directly CImg<float> instead of having to specify
 
@@ -18,6 +19,10 @@ using namespace cimg_library;
 
 #include <sstream>
 
+#include <cstring>
+
+#include <cfloat>
+
 #ifdef max
 #undef max
 #endif
@@ -86,20 +91,14 @@ void SinusoidalMasks(float freq, float dir,
 
 void WriteImage(const CImg<float>& img, const char* fn)
 {
-    float mn = img.min();
-    float mx = img.max();
+    float mx;
+    float mn = img.minmax(mx);
         
-    CImg<unsigned char> to_disk(img.dimx(), img.dimy());
     //Perform value quantization to the interval [0-256) because when
     //the image is written to the disk each pixel must be one byte,
     //i.e. a number in that interval.
-    for(int i = 0; i < img.dimx(); i++)
-    {
-        for(int j = 0; j < img.dimy(); j++)
-        {
-            to_disk(i,j) = static_cast<unsigned char>(255*(img(i,j) - mn)/(mx - mn));
-        }
-    }
+    CImg<unsigned char> to_disk;
+    QuantizeImage(img, mn, mx, to_disk);
 
     //Write the image to the disk
     std::cout << "Writing file: " << fn << std::endl;
@@ -107,7 +106,13 @@ void WriteImage(const CImg<float>& img, const char* fn)
 }
 
 
-CImg<float> GaborFilter(float sigma, float freq, float dir, CImg<float> img)
+/*!
+ * \brief Magnitude of the response of a Gabor filter
+ * \param mn, mx  if not null, range of the response (output), computed in
+ *                the same pass as the magnitude
+ */
+CImg<float> GaborFilter(float sigma, float freq, float dir, CImg<float> img,
+                        float* mn = 0, float* mx = 0)
 {
     CImg<float> g_mask = GaussianMask(sigma, 5*sigma);
     CImg<float> c_mask(g_mask.dimx(), g_mask.dimy());
@@ -120,39 +125,109 @@ CImg<float> GaborFilter(float sigma, float freq, float dir, CImg<float> img)
 
     CImg<float> out_c = img.get_convolve(gf_cos);
     CImg<float> out_s = img.get_convolve(gf_sin);
-    CImg<float> out = out_c.sqr() + out_s.sqr();
 
-    return out.get_sqrt();
+    CImg<float> out(out_c.dimx(), out_c.dimy(), out_c.dimz(), out_c.dimv());
+    const float *c = out_c.ptr();
+    const float *s = out_s.ptr();
+    float *o = out.ptr();
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    unsigned long n = out.size();
+    for(unsigned long i = 0; i < n; i++)
+    {
+        o[i] = sqrt(c[i]*c[i] + s[i]*s[i]);
+        lo = o[i] < lo ? o[i] : lo;
+        hi = o[i] > hi ? o[i] : hi;
+    }
+    if(mn)
+        *mn = lo;
+    if(mx)
+        *mx = hi;
+
+    return out;
 }
 
 /* Bonus */
-CImg<int> GaborSegmentation(CImg<float>* scale_filts, int n_dirs)
-{
-
-    int dx = scale_filts[0].dimx();
-    int dy = scale_filts[0].dimy();
 
-    CImg<int> ret(dx,dy);
-    for(int x = 0; x < dx; x++)
+/*!
+ * \brief Index of the direction of maximal response at every pixel.
+ *
+ * The responses are stored in one contiguous stack, one plane per
+ * (direction, scale): bank(x, y, direction, scale). Every row is
+ * processed in memory order with a float running maximum, so that the
+ * inner loop over x is a branch-free select the compiler can vectorise.
+ * The argmax over all scales and the argmax of each scale are computed
+ * in the same pass.
+ *
+ * \param bank        the filter responses, n_dirs planes per scale
+ * \param all_scales  if not null, label s*n_dirs + d of the best
+ *                    (scale s, direction d) over all the bank
+ * \param per_scale   if not null, one channel per scale holding the
+ *                    best direction of that scale
+ */
+void GaborArgmax(const CImg<float>& bank, CImg<int>* all_scales, CImg<int>* per_scale)
+{
+    int dx = bank.dimx();
+    int dy = bank.dimy();
+    int n_dirs = bank.dimz();
+    int n_scales = bank.dimv();
+
+    if(all_scales)
+        all_scales->assign(dx, dy);
+    if(per_scale)
+        per_scale->assign(dx, dy, 1, n_scales);
+
+#ifdef cimg_use_openmp
+#pragma omp parallel
+#endif
     {
+        // running maxima of the current scale and of all the scales
+        CImg<float> best(dx), best_all(dx);
+        CImg<int> arg(dx), arg_all(dx);
+
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
         for(int y = 0; y < dy; y++)
         {
-            int max = scale_filts[0].at(x,y);
-            int argm = 0;
-            for(int i = 1; i < n_dirs; i++)
+            for(int s = 0; s < n_scales; s++)
             {
-                if(scale_filts[i](x,y) > max)
+                float *b = best.ptr();
+                int *a = arg.ptr();
+                const float *row = bank.ptr(0, y, 0, s);
+                for(int x = 0; x < dx; x++)
                 {
-                    max = scale_filts[i].at(x,y);
-                    argm = i;
+                    b[x] = row[x];
+                    a[x] = 0;
+                }
+                for(int d = 1; d < n_dirs; d++)
+                {
+                    row = bank.ptr(0, y, d, s);
+                    for(int x = 0; x < dx; x++)
+                    {
+                        bool greater = row[x] > b[x];
+                        b[x] = greater ? row[x] : b[x];
+                        a[x] = greater ? d : a[x];
+                    }
+                }
+
+                if(per_scale)
+                    std::memcpy(per_scale->ptr(0, y, 0, s), a, dx*sizeof(int));
+
+                float *b_all = best_all.ptr();
+                int *a_all = arg_all.ptr();
+                int label = s*n_dirs;
+                for(int x = 0; x < dx; x++)
+                {
+                    bool greater = s == 0 || b[x] > b_all[x];
+                    b_all[x] = greater ? b[x] : b_all[x];
+                    a_all[x] = greater ? label + a[x] : a_all[x];
                 }
             }
-            ret(x,y) = argm;
+
+            if(all_scales)
+                std::memcpy(all_scales->ptr(0, y), arg_all.ptr(), dx*sizeof(int));
         }
     }
-
-    return ret;
-
 }
 
 
@@ -180,23 +255,13 @@ int main(int argc, char** argv)
     std::cin >> num_directions;
     std::cout << std::endl;
 
-    //	tables with the responces of the Gabor filters
-    CImg<float> **filtered = new CImg<float>*[num_scales];
-    if(filtered == 0)
-    {
-        std::cerr << "Cannot allocate memory. Exiting" << std::endl;
-        exit(2);
-    }
-    for(int i = 0; i < num_scales; i++)
-    {
-        filtered[i] = new CImg<float>[num_directions];
-        if(filtered[i] == 0)
-        {
-            std::cerr << "Cannot allocate memory. Exiting" << std::endl;
-            exit(2);
-        }
-    }
-    
+    //	stack with the responces of the Gabor filters, one plane per
+    //	(direction, scale)
+    CImg<float> bank(img_raw.dimx(), img_raw.dimy(), num_directions, num_scales);
+
+    //  the planes of bank are written without copy, bank must outlive
+    //  the writer
+    AsyncImageWriter writer;
 
     double factor = sqrt(2.0);
     float sigma_scale;
@@ -211,29 +276,43 @@ int main(int argc, char** argv)
             int n_pix = 2*(5*sigma_scale) + 1;
             float freq = 3.0/n_pix;
 
-            filtered[i][j] = GaborFilter(sigma_scale, freq,  dir, img_raw);
+            float mn, mx;
+            bank.draw_image(0, 0, j, i, GaborFilter(sigma_scale, freq,  dir, img_raw, &mn, &mx));
 
             
-            //Save the filtered images
+            //Save the filtered images, while the next one is computed
             std::stringstream fn;
             int dir_deg = static_cast<int>(dir*180/M_PI);
             fn << "img_" << i << "_" << dir_deg << ".pgm";
-            WriteImage(filtered[i][j], fn.str().c_str());
+            writer.Write(bank.get_shared_plane(j, i), mn, mx, fn.str());
         }
 
         sigma_scale = sigma_scale*factor;
     }
+    writer.Flush();
 
     int sc = 0;
         
     if(num_scales != 1)
     {
-        std::cout << "Which scale should be segmented? (0-" << num_scales - 1 << ") ";
+        std::cout << "Which scale should be segmented? (0-" << num_scales - 1
+                  << ", -1 for all the scales) ";
         
         std::cin >> sc;
         std::cout << std::endl;
     }
-    CImg<int> segm = GaborSegmentation(filtered[sc], num_directions);
+    CImg<int> segm;
+    if(sc < 0)
+    {
+        //  labels are scale*num_directions + direction
+        GaborArgmax(bank, &segm, 0);
+    }
+    else
+    {
+        CImg<int> per_scale;
+        GaborArgmax(bank, 0, &per_scale);
+        segm = per_scale.get_channel(sc);
+    }
     segm.save("output.pgm");
 
 
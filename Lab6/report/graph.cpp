@@ -0,0 +1,106 @@
+/* graph.cpp */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "graph.h"
+#include "instances.inc"
+
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	Graph<captype, tcaptype, flowtype>::Graph(int _node_num_max, int edge_num_max, void (*err_function)(char *))
+	: node_num(0),
+	  node_num_max(_node_num_max),
+	  error_function(err_function)
+{
+	if (node_num_max < 16) node_num_max = 16;
+	if (edge_num_max < 16) edge_num_max = 16;
+	arc_num = FIRST_ARC;
+	arc_num_max = FIRST_ARC + 2*edge_num_max;
+	nodeptr_num_max = NODEPTR_BLOCK_SIZE;
+
+	nodes = (node*) malloc(node_num_max*sizeof(node));
+	arcs = (arc*) malloc(arc_num_max*sizeof(arc));
+	nodeptrs = (nodeptr*) malloc(nodeptr_num_max*sizeof(nodeptr));
+	if (!nodes || !arcs || !nodeptrs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+
+	/* free list of the orphans, without the item 0 */
+	for (int np=1; np<nodeptr_num_max-1; np++) nodeptrs[np].next = np + 1;
+	nodeptrs[nodeptr_num_max-1].next = 0;
+	nodeptr_free = 1;
+
+	queue_first[1] = queue_last[1] = -1;
+	maxflow_iteration = 0;
+	flow = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	Graph<captype,tcaptype,flowtype>::~Graph()
+{
+	free(nodes);
+	free(arcs);
+	free(nodeptrs);
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::reset()
+{
+	// the arrays are kept; the free list of the orphans is complete,
+	// since maxflow() releases all the orphans it creates
+	node_num = 0;
+	arc_num = FIRST_ARC;
+
+	queue_first[1] = queue_last[1] = -1;
+	maxflow_iteration = 0;
+	flow = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::reserve(int _node_num_max, int edge_num_max)
+{
+	if (_node_num_max > node_num_max)
+	{
+		node_num_max = _node_num_max;
+		nodes = (node*) realloc(nodes, node_num_max*sizeof(node));
+		if (!nodes) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+	}
+	if (FIRST_ARC + 2*edge_num_max > arc_num_max)
+	{
+		arc_num_max = FIRST_ARC + 2*edge_num_max;
+		arcs = (arc*) realloc(arcs, arc_num_max*sizeof(arc));
+		if (!arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::reallocate_nodes(int num)
+{
+	node_num_max += node_num_max / 2;
+	if (node_num_max < node_num + num) node_num_max = node_num + num;
+	nodes = (node*) realloc(nodes, node_num_max*sizeof(node));
+	if (!nodes) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::reallocate_arcs()
+{
+	arc_num_max += arc_num_max / 2; if (arc_num_max & 1) arc_num_max ++;
+	arcs = (arc*) realloc(arcs, arc_num_max*sizeof(arc));
+	if (!arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::reallocate_nodeptrs()
+{
+	int np, np_num_max = nodeptr_num_max;
+
+	nodeptr_num_max += nodeptr_num_max / 2;
+	nodeptrs = (nodeptr*) realloc(nodeptrs, nodeptr_num_max*sizeof(nodeptr));
+	if (!nodeptrs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+
+	/* the new items are free */
+	for (np=np_num_max; np<nodeptr_num_max-1; np++) nodeptrs[np].next = np + 1;
+	nodeptrs[nodeptr_num_max-1].next = nodeptr_free;
+	nodeptr_free = np_num_max;
+}
@@ -0,0 +1,77 @@
+/* gridgraph.cpp */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gridgraph.h"
+#include "gridinstances.inc"
+
+
+template <typename captype, typename tcaptype, typename flowtype>
+	GridGraph<captype, tcaptype, flowtype>::GridGraph(int _width, int _height, int connectivity, void (*err_function)(char *))
+	: width(_width),
+	  height(_height),
+	  error_function(err_function),
+	  excess(NULL),
+	  label(NULL),
+	  block_active(NULL),
+	  block_size(0)
+{
+	if (width < 1 || height < 1) { if (error_function) (*error_function)((char *)"Empty grid!"); exit(1); }
+	if (connectivity != 4 && connectivity != 8) { if (error_function) (*error_function)((char *)"The connectivity must be 4 or 8!"); exit(1); }
+
+	K = connectivity;
+	K_SHIFT = (K == 4) ? 2 : 3;
+	pwidth = width + 2;
+	node_num = pwidth*(height + 2);
+
+	offset[RIGHT]		=  1;
+	offset[LEFT]		= -1;
+	offset[DOWN]		=  pwidth;
+	offset[UP]			= -pwidth;
+	offset[DOWN_RIGHT]	=  pwidth + 1;
+	offset[UP_LEFT]		= -pwidth - 1;
+	offset[UP_RIGHT]	= -pwidth + 1;
+	offset[DOWN_LEFT]	=  pwidth - 1;
+
+	nodes = (node*) malloc(node_num*sizeof(node));
+	r_cap = (captype*) malloc(((size_t)node_num<<K_SHIFT)*sizeof(captype));
+	orphans = (int*) malloc(node_num*sizeof(int));
+	if (!nodes || !r_cap || !orphans)
+	{
+		if (error_function) (*error_function)((char *)"Not enough memory!");
+		exit(1);
+	}
+
+	reset();
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	GridGraph<captype,tcaptype,flowtype>::~GridGraph()
+{
+	free(nodes);
+	free(r_cap);
+	free(orphans);
+	free(excess);
+	free(label);
+	free(block_active);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::reset()
+{
+	// the border nodes keep these values: no t-links, no arcs and no parent
+	memset(nodes, 0, node_num*sizeof(node));
+	memset(r_cap, 0, ((size_t)node_num<<K_SHIFT)*sizeof(captype));
+
+	flow = 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	size_t GridGraph<captype,tcaptype,flowtype>::get_memory_size()
+{
+	size_t size = (size_t)node_num*(sizeof(node) + K*sizeof(captype) + sizeof(int));
+	if (excess) size += (size_t)node_num*(sizeof(tcaptype) + sizeof(int)) + block_num_x*block_num_y;
+	return size;
+}
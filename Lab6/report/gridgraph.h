@@ -0,0 +1,277 @@
+/* gridgraph.h */
+/*
+	Boykov-Kolmogorov maxflow (see graph.h) specialised to the graphs
+	built on an image: one node per pixel and edges between the
+	4- or 8-neighbours of a pixel only.
+
+	The algorithm and the search trees are the same as in maxflow.cpp,
+	so for a given energy the minimum cut returned by what_segment() is
+	the same as the one of Graph. The storage is different:
+	  - the neighbours of a node are found by adding a constant offset
+	    to its index, there are no node or arc pointers;
+	  - the residual capacities of the arcs leaving a node are stored
+	    contiguously, in a single array for the whole grid;
+	  - the grid is padded with a border of nodes which are never in a
+	    search tree, so that the neighbours of a pixel never have to be
+	    checked against the image boundary.
+
+	Nodes are the pixels in row-major order: the node of pixel (x,y)
+	is y*width+x.
+*/
+
+#ifndef __GRIDGRAPH_H__
+#define __GRIDGRAPH_H__
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <vector>
+// NOTE: in UNIX you need to use -DNDEBUG preprocessor option to supress assert's!!!
+
+
+
+// captype: type of edge capacities (excluding t-links)
+// tcaptype: type of t-links (edges between nodes and terminals)
+// flowtype: type of total flow
+//
+// Current instantiations are in gridinstances.inc
+template <typename captype, typename tcaptype, typename flowtype> class GridGraph
+{
+public:
+	typedef enum
+	{
+		SOURCE	= 0,
+		SINK	= 1
+	} termtype; // terminals
+	typedef int node_id;
+
+	// Directions of the arcs leaving a node. A direction and its
+	// opposite differ only by the last bit (opposite = dir^1).
+	// The first four are used with 4-connectivity, all of them with 8-connectivity.
+	typedef enum
+	{
+		RIGHT		= 0,	// (x+1,y)
+		LEFT		= 1,	// (x-1,y)
+		DOWN		= 2,	// (x,y+1)
+		UP			= 3,	// (x,y-1)
+		DOWN_RIGHT	= 4,	// (x+1,y+1)
+		UP_LEFT		= 5,	// (x-1,y-1)
+		UP_RIGHT	= 6,	// (x+1,y-1)
+		DOWN_LEFT	= 7		// (x-1,y+1)
+	} direction;
+
+	// Constructor. Allocates all the nodes and arcs of a width x height grid
+	// with the given connectivity (4 or 8). All capacities are zero.
+	// The last (optional) argument is the pointer to the function which will be called
+	// if an error occurs; an error message is passed to this function.
+	// If this argument is omitted, exit(1) will be called.
+	GridGraph(int width, int height, int connectivity = 4, void (*err_function)(char *) = NULL);
+
+	// Destructor
+	~GridGraph();
+
+	int get_width() { return width; }
+	int get_height() { return height; }
+	int get_connectivity() { return K; }
+	int get_node_num() { return width*height; }
+
+	// Returns the node of pixel (x,y)
+	node_id get_node_id(int x, int y) { return y*width + x; }
+
+	// Adds 'cap' to the arc going from (x,y) in direction 'dir'
+	// and 'rev_cap' to the reverse arc. The neighbour must be in the image.
+	void add_edge(int x, int y, direction dir, captype cap, captype rev_cap);
+
+	// Same interface as Graph::add_edge(): 'i' and 'j' must be grid neighbours.
+	void add_edge(node_id i, node_id j, captype cap, captype rev_cap);
+
+	// Adds new edges 'SOURCE->i' and 'i->SINK' with corresponding weights.
+	// Can be called multiple times for each node.
+	// Weights can be negative.
+	void add_tweights(node_id i, tcaptype cap_source, tcaptype cap_sink);
+
+	// Computes the maxflow. Can be called several times.
+	flowtype maxflow();
+
+	// Computes the maxflow with a parallel push-relabel algorithm: the image is
+	// divided in blocks of block_size x block_size pixels, and the blocks which
+	// do not touch each other are discharged at the same time (with OpenMP,
+	// see gridregionmaxflow.cpp). maxflow() is then called to build the search
+	// trees, so that what_segment() returns exactly the cut of maxflow().
+	// block_size must be at least 2.
+	flowtype maxflow_parallel(int block_size = 64);
+
+	// After the maxflow is computed, this function returns to which
+	// segment the node 'i' belongs (GridGraph<captype,tcaptype,flowtype>::SOURCE or GridGraph<captype,tcaptype,flowtype>::SINK).
+	//
+	// Occasionally there may be several minimum cuts. If a node can be assigned
+	// to both the source and the sink, then default_segm is returned.
+	termtype what_segment(node_id i, termtype default_segm = SOURCE);
+
+	// Removes the flow and sets all capacities to zero. The grid is kept.
+	void reset();
+
+	// returns residual capacity of SOURCE->i minus residual capacity of i->SINK
+	tcaptype get_trcap(node_id i) { return nodes[pad(i)].tr_cap; }
+	// returns residual capacity of the arc going from node 'i' in direction 'dir'
+	captype get_rcap(node_id i, direction dir) { return r_cap[(pad(i)<<K_SHIFT) + dir]; }
+
+	// Memory used by the graph, in bytes
+	size_t get_memory_size();
+
+
+/////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////
+
+private:
+	// internal variables and functions
+
+	// A node is an index in the padded grid, an arc is the index of its
+	// residual capacity in r_cap: (node<<K_SHIFT) + direction.
+	typedef int arc_id;
+
+	int					width, height;	// size of the image
+	int					pwidth;			// width of the padded grid
+	int					K, K_SHIFT;		// connectivity and log2(connectivity)
+	int					node_num;		// number of nodes of the padded grid
+	int					offset[8];		// offset of the neighbour in each direction
+
+	struct node
+	{
+		int			next;		// next active node
+								//   (itself if it is the last node in the list, -1 if not in the list)
+		int			TS;			// timestamp showing when DIST was computed
+		int			DIST;		// distance to the terminal
+		tcaptype	tr_cap;		// if tr_cap > 0 then tr_cap is residual capacity of the arc SOURCE->node
+								// otherwise         -tr_cap is residual capacity of the arc node->SINK
+		unsigned char	parent;		// 0 if the node has no parent, TERMINAL, ORPHAN or
+									// 1+direction of the arc going to the parent
+		unsigned char	is_sink;	// flag showing whether the node is in the source or in the sink tree (if parent!=0)
+	};
+
+	node				*nodes;		// nodes of the padded grid
+	captype				*r_cap;		// residual capacities of the arcs, K per node
+
+	void	(*error_function)(char *);	// this function is called if a error occurs,
+										// with a corresponding error message
+										// (or exit(1) is called if it's NULL)
+
+	flowtype			flow;		// total flow
+
+	/////////////////////////////////////////////////////////////////////////
+
+	int					queue_first[2], queue_last[2];	// list of active nodes
+	int					*orphans;						// circular list of orphans
+	int					orphan_first, orphan_num;
+	int					TIME;							// monotonically increasing global counter
+
+	/////////////////////////////////////////////////////////////////////////
+
+	// push-relabel (maxflow_parallel), allocated on the first call
+	tcaptype			*excess;		// excess of each node
+	int					*label;			// distance label of each node, node_num if it cannot reach the sink
+	unsigned char		*block_active;	// whether a block contains active nodes
+	int					block_size, block_num_x, block_num_y;
+
+	/////////////////////////////////////////////////////////////////////////
+
+	// index of a pixel node in the padded grid
+	int pad(node_id i) { return (i/width + 1)*pwidth + i%width + 1; }
+	int head(arc_id a) { return (a>>K_SHIFT) + offset[a & (K-1)]; }
+	arc_id sister(arc_id a) { return (head(a)<<K_SHIFT) + ((a & (K-1))^1); }
+
+	// functions for processing active list
+	void set_active(int i);
+	int next_active();
+
+	// functions for processing orphans list
+	void set_orphan_front(int i); // add to the beginning of the list
+	void set_orphan_rear(int i);  // add to the end of the list
+
+	void maxflow_init();
+	void augment(arc_id middle_arc);
+	void process_source_orphan(int i);
+	void process_sink_orphan(int i);
+
+	// functions of the push-relabel algorithm
+	int global_relabel();
+	void region_relabel(int x0, int x1, int y0, int y1, std::vector<int>& queue);
+	flowtype discharge_block(int bx, int by, std::vector<int>& queue);
+};
+
+
+
+
+
+
+
+
+
+
+
+///////////////////////////////////////
+// Implementation - inline functions //
+///////////////////////////////////////
+
+
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::add_tweights(node_id _i, tcaptype cap_source, tcaptype cap_sink)
+{
+	assert(_i >= 0 && _i < width*height);
+
+	int i = pad(_i);
+	tcaptype delta = nodes[i].tr_cap;
+	if (delta > 0) cap_source += delta;
+	else           cap_sink   -= delta;
+	flow += (cap_source < cap_sink) ? cap_source : cap_sink;
+	nodes[i].tr_cap = cap_source - cap_sink;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::add_edge(int x, int y, direction dir, captype cap, captype rev_cap)
+{
+	assert(x >= 0 && x < width && y >= 0 && y < height);
+	assert(dir < K);
+	assert(cap >= 0);
+	assert(rev_cap >= 0);
+
+	arc_id a = (((y+1)*pwidth + x+1)<<K_SHIFT) + dir;
+	assert(head(a) % pwidth > 0 && head(a) % pwidth <= width);
+	assert(head(a) / pwidth > 0 && head(a) / pwidth <= height);
+
+	r_cap[a] += cap;
+	r_cap[sister(a)] += rev_cap;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::add_edge(node_id _i, node_id _j, captype cap, captype rev_cap)
+{
+	assert(_i >= 0 && _i < width*height);
+	assert(_j >= 0 && _j < width*height);
+
+	int i = pad(_i), j = pad(_j);
+	int dir;
+	for (dir=0; dir<K; dir++) if (i + offset[dir] == j) break;
+	if (dir == K) { if (error_function) (*error_function)((char *)"add_edge() between nodes which are not grid neighbours!"); exit(1); }
+
+	add_edge(_i % width, _i / width, (direction)dir, cap, rev_cap);
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline typename GridGraph<captype,tcaptype,flowtype>::termtype GridGraph<captype,tcaptype,flowtype>::what_segment(node_id i, termtype default_segm)
+{
+	int p = pad(i);
+	if (nodes[p].parent)
+	{
+		return (nodes[p].is_sink) ? SINK : SOURCE;
+	}
+	else
+	{
+		return default_segm;
+	}
+}
+
+
+#endif
@@ -0,0 +1,476 @@
+/* gridmaxflow.cpp */
+/*
+	Same algorithm as maxflow.cpp, written with node and arc indices.
+	The comments of maxflow.cpp apply.
+*/
+
+
+#include <stdio.h>
+#include "gridgraph.h"
+#include "gridinstances.inc"
+
+
+/*
+	special constants for nodes[].parent
+*/
+#define TERMINAL	9		/* to terminal */
+#define ORPHAN		10		/* orphan */
+
+
+#define INFINITE_D ((int)(((unsigned)-1)/2))		/* infinite distance to the terminal */
+
+/***********************************************************************/
+
+/*
+	Functions for processing active list.
+	nodes[i].next is the next node in the list
+	(or i, if i is the last node in the list).
+	nodes[i].next is -1 iff i is not in the list.
+*/
+
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_active(int i)
+{
+	if (nodes[i].next < 0)
+	{
+		/* it's not in the list yet */
+		if (queue_last[1] >= 0) nodes[queue_last[1]].next = i;
+		else                    queue_first[1]            = i;
+		queue_last[1] = i;
+		nodes[i].next = i;
+	}
+}
+
+/*
+	Returns the next active node.
+	If it is connected to the sink, it stays in the list,
+	otherwise it is removed from the list
+*/
+template <typename captype, typename tcaptype, typename flowtype>
+	inline int GridGraph<captype,tcaptype,flowtype>::next_active()
+{
+	int i;
+
+	while ( 1 )
+	{
+		if ((i=queue_first[0]) < 0)
+		{
+			queue_first[0] = i = queue_first[1];
+			queue_last[0]  = queue_last[1];
+			queue_first[1] = -1;
+			queue_last[1]  = -1;
+			if (i < 0) return -1;
+		}
+
+		/* remove it from the active list */
+		if (nodes[i].next == i) queue_first[0] = queue_last[0] = -1;
+		else                    queue_first[0] = nodes[i].next;
+		nodes[i].next = -1;
+
+		/* a node in the list is active iff it has a parent */
+		if (nodes[i].parent) return i;
+	}
+}
+
+/***********************************************************************/
+
+/*
+	The orphans are kept in a circular buffer of node_num entries:
+	a node is at most once in the list, since its parent is ORPHAN
+	until it is processed.
+*/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_orphan_front(int i)
+{
+	nodes[i].parent = ORPHAN;
+	if (-- orphan_first < 0) orphan_first += node_num;
+	orphans[orphan_first] = i;
+	orphan_num ++;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	inline void GridGraph<captype,tcaptype,flowtype>::set_orphan_rear(int i)
+{
+	int k = orphan_first + orphan_num;
+	if (k >= node_num) k -= node_num;
+	nodes[i].parent = ORPHAN;
+	orphans[k] = i;
+	orphan_num ++;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::maxflow_init()
+{
+	int i;
+
+	queue_first[0] = queue_last[0] = -1;
+	queue_first[1] = queue_last[1] = -1;
+	orphan_first = orphan_num = 0;
+
+	TIME = 0;
+
+	for (i=0; i<node_num; i++)
+	{
+		nodes[i].next = -1;
+		nodes[i].TS = TIME;
+		if (nodes[i].tr_cap > 0)
+		{
+			/* i is connected to the source */
+			nodes[i].is_sink = 0;
+			nodes[i].parent = TERMINAL;
+			set_active(i);
+			nodes[i].DIST = 1;
+		}
+		else if (nodes[i].tr_cap < 0)
+		{
+			/* i is connected to the sink */
+			nodes[i].is_sink = 1;
+			nodes[i].parent = TERMINAL;
+			set_active(i);
+			nodes[i].DIST = 1;
+		}
+		else
+		{
+			nodes[i].parent = 0;
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::augment(arc_id middle_arc)
+{
+	int i;
+	arc_id a;
+	tcaptype bottleneck;
+
+
+	/* 1. Finding bottleneck capacity */
+	/* 1a - the source tree */
+	bottleneck = r_cap[middle_arc];
+	for (i=middle_arc>>K_SHIFT; ; i=head(a))
+	{
+		if (nodes[i].parent == TERMINAL) break;
+		a = (i<<K_SHIFT) + nodes[i].parent - 1;
+		if (bottleneck > r_cap[sister(a)]) bottleneck = r_cap[sister(a)];
+	}
+	if (bottleneck > nodes[i].tr_cap) bottleneck = nodes[i].tr_cap;
+	/* 1b - the sink tree */
+	for (i=head(middle_arc); ; i=head(a))
+	{
+		if (nodes[i].parent == TERMINAL) break;
+		a = (i<<K_SHIFT) + nodes[i].parent - 1;
+		if (bottleneck > r_cap[a]) bottleneck = r_cap[a];
+	}
+	if (bottleneck > - nodes[i].tr_cap) bottleneck = - nodes[i].tr_cap;
+
+
+	/* 2. Augmenting */
+	/* 2a - the source tree */
+	r_cap[sister(middle_arc)] += bottleneck;
+	r_cap[middle_arc] -= bottleneck;
+	for (i=middle_arc>>K_SHIFT; ; i=head(a))
+	{
+		if (nodes[i].parent == TERMINAL) break;
+		a = (i<<K_SHIFT) + nodes[i].parent - 1;
+		arc_id a_rev = sister(a);
+		r_cap[a] += bottleneck;
+		r_cap[a_rev] -= bottleneck;
+		if (!r_cap[a_rev])
+		{
+			set_orphan_front(i); // add i to the beginning of the adoption list
+		}
+	}
+	nodes[i].tr_cap -= bottleneck;
+	if (!nodes[i].tr_cap)
+	{
+		set_orphan_front(i); // add i to the beginning of the adoption list
+	}
+	/* 2b - the sink tree */
+	for (i=head(middle_arc); ; i=head(a))
+	{
+		if (nodes[i].parent == TERMINAL) break;
+		a = (i<<K_SHIFT) + nodes[i].parent - 1;
+		r_cap[sister(a)] += bottleneck;
+		r_cap[a] -= bottleneck;
+		if (!r_cap[a])
+		{
+			set_orphan_front(i); // add i to the beginning of the adoption list
+		}
+	}
+	nodes[i].tr_cap += bottleneck;
+	if (!nodes[i].tr_cap)
+	{
+		set_orphan_front(i); // add i to the beginning of the adoption list
+	}
+
+
+	flow += bottleneck;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::process_source_orphan(int i)
+{
+	int j, k, k_min = -1;
+	unsigned char a;
+	int d, d_min = INFINITE_D;
+
+	/* trying to find a new parent */
+	for (k=0; k<K; k++)
+	if (r_cap[sister((i<<K_SHIFT) + k)])
+	{
+		j = i + offset[k];
+		if (!nodes[j].is_sink && (a=nodes[j].parent))
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (nodes[j].TS == TIME)
+				{
+					d += nodes[j].DIST;
+					break;
+				}
+				a = nodes[j].parent;
+				d ++;
+				if (a==TERMINAL)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j += offset[a-1];
+			}
+			if (d<INFINITE_D) /* j originates from the source - done */
+			{
+				if (d<d_min)
+				{
+					k_min = k;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=i+offset[k]; nodes[j].TS!=TIME; j+=offset[nodes[j].parent-1])
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = d --;
+				}
+			}
+		}
+	}
+
+	if (k_min >= 0)
+	{
+		nodes[i].parent = k_min + 1;
+		nodes[i].TS = TIME;
+		nodes[i].DIST = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		nodes[i].parent = 0;
+
+		/* process neighbors */
+		for (k=0; k<K; k++)
+		{
+			j = i + offset[k];
+			if (!nodes[j].is_sink && (a=nodes[j].parent))
+			{
+				if (r_cap[sister((i<<K_SHIFT) + k)]) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && j+offset[a-1]==i)
+				{
+					set_orphan_rear(j); // add j to the end of the adoption list
+				}
+			}
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::process_sink_orphan(int i)
+{
+	int j, k, k_min = -1;
+	unsigned char a;
+	int d, d_min = INFINITE_D;
+
+	/* trying to find a new parent */
+	for (k=0; k<K; k++)
+	if (r_cap[(i<<K_SHIFT) + k])
+	{
+		j = i + offset[k];
+		if (nodes[j].is_sink && (a=nodes[j].parent))
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (nodes[j].TS == TIME)
+				{
+					d += nodes[j].DIST;
+					break;
+				}
+				a = nodes[j].parent;
+				d ++;
+				if (a==TERMINAL)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j += offset[a-1];
+			}
+			if (d<INFINITE_D) /* j originates from the sink - done */
+			{
+				if (d<d_min)
+				{
+					k_min = k;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=i+offset[k]; nodes[j].TS!=TIME; j+=offset[nodes[j].parent-1])
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = d --;
+				}
+			}
+		}
+	}
+
+	if (k_min >= 0)
+	{
+		nodes[i].parent = k_min + 1;
+		nodes[i].TS = TIME;
+		nodes[i].DIST = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		nodes[i].parent = 0;
+
+		/* process neighbors */
+		for (k=0; k<K; k++)
+		{
+			j = i + offset[k];
+			if (nodes[j].is_sink && (a=nodes[j].parent))
+			{
+				if (r_cap[(i<<K_SHIFT) + k]) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && j+offset[a-1]==i)
+				{
+					set_orphan_rear(j); // add j to the end of the adoption list
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype GridGraph<captype,tcaptype,flowtype>::maxflow()
+{
+	int i, j, k, current_node = -1;
+	arc_id a;
+
+	maxflow_init();
+
+	// main loop
+	while ( 1 )
+	{
+		if ((i=current_node) >= 0)
+		{
+			nodes[i].next = -1; /* remove active flag */
+			if (!nodes[i].parent) i = -1;
+		}
+		if (i < 0)
+		{
+			if ((i = next_active()) < 0) break;
+		}
+
+		/* growth */
+		a = -1;
+		if (!nodes[i].is_sink)
+		{
+			/* grow source tree */
+			for (k=0; k<K; k++)
+			if (r_cap[(i<<K_SHIFT) + k])
+			{
+				j = i + offset[k];
+				if (!nodes[j].parent)
+				{
+					nodes[j].is_sink = 0;
+					nodes[j].parent = (k^1) + 1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+					set_active(j);
+				}
+				else if (nodes[j].is_sink) { a = (i<<K_SHIFT) + k; break; }
+				else if (nodes[j].TS <= nodes[i].TS &&
+				         nodes[j].DIST > nodes[i].DIST)
+				{
+					/* heuristic - trying to make the distance from j to the source shorter */
+					nodes[j].parent = (k^1) + 1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+				}
+			}
+		}
+		else
+		{
+			/* grow sink tree */
+			for (k=0; k<K; k++)
+			if (r_cap[sister((i<<K_SHIFT) + k)])
+			{
+				j = i + offset[k];
+				if (!nodes[j].parent)
+				{
+					nodes[j].is_sink = 1;
+					nodes[j].parent = (k^1) + 1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+					set_active(j);
+				}
+				else if (!nodes[j].is_sink) { a = sister((i<<K_SHIFT) + k); break; }
+				else if (nodes[j].TS <= nodes[i].TS &&
+				         nodes[j].DIST > nodes[i].DIST)
+				{
+					/* heuristic - trying to make the distance from j to the sink shorter */
+					nodes[j].parent = (k^1) + 1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+				}
+			}
+		}
+
+		TIME ++;
+
+		if (a >= 0)
+		{
+			nodes[i].next = i; /* set active flag */
+			current_node = i;
+
+			/* augmentation */
+			augment(a);
+			/* augmentation end */
+
+			/* adoption */
+			while (orphan_num)
+			{
+				i = orphans[orphan_first];
+				if (++ orphan_first == node_num) orphan_first = 0;
+				orphan_num --;
+				if (nodes[i].is_sink) process_sink_orphan(i);
+				else            process_source_orphan(i);
+			}
+			/* adoption end */
+		}
+		else current_node = -1;
+	}
+
+	return flow;
+}
@@ -0,0 +1,315 @@
+/* gridregionmaxflow.cpp */
+/*
+	Parallel push-relabel maxflow on a GridGraph.
+
+	The image is divided in blocks (regions). A sweep discharges every block
+	which contains active nodes (nodes with an excess and a label smaller than
+	node_num): the active nodes of the block are processed in FIFO order with
+	the usual push and relabel operations, and the flow pushed out of the
+	block becomes the excess of the neighbouring blocks, which are processed
+	later. The blocks are coloured as a 2x2 checkerboard of blocks: two blocks
+	of the same colour are separated by at least one block, so they are
+	discharged in parallel without locks. A push from a node of the block can
+	only modify the node, its arcs, the reverse arc and the excess of a
+	neighbour, and the neighbours of two blocks of the same colour are
+	different nodes as soon as block_size >= 2. The labels of the neighbours
+	outside the block are only read.
+
+	Each sweep starts with a global relabeling (breadth first search from the
+	sink in the residual graph), which gives the exact distances to the sink
+	and the active nodes. Within a block, the labels are computed again
+	in the same way (region relabeling) when the number of relabel operations
+	exceeds the number of nodes of the block, with the labels of the
+	neighbours outside the block as boundary conditions. The algorithm stops when no node is active: the
+	preflow is then maximal, and the nodes which can still reach the sink are
+	the same as with any maximum flow.
+
+	The remaining excess of a node is moved back to its source t-link. This is
+	a reparametrisation (the same constant is added to both t-links of the
+	node) which does not change the minimum cuts, and the residual graph is
+	then a valid input for maxflow(): it does not find any augmenting path,
+	and only builds the search trees used by what_segment().
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gridgraph.h"
+#include "gridinstances.inc"
+
+#ifdef cimg_use_openmp
+#include <omp.h>
+#endif
+
+
+template <typename captype, typename tcaptype, typename flowtype>
+	int GridGraph<captype,tcaptype,flowtype>::global_relabel()
+{
+	int i, j, k, bx, by, x, y;
+	int *queue = orphans, queue_first = 0, queue_last = 0;
+	int active_num = 0;
+
+	for (i=0; i<node_num; i++) label[i] = node_num;
+
+	/* the nodes with a residual capacity to the sink are at distance 1 */
+	for (y=0; y<height; y++)
+	for (x=0, i=(y+1)*pwidth+1; x<width; x++, i++)
+	{
+		if (nodes[i].tr_cap < 0)
+		{
+			label[i] = 1;
+			queue[queue_last ++] = i;
+		}
+	}
+
+	/* breadth first search on the reverse residual arcs */
+	while (queue_first < queue_last)
+	{
+		i = queue[queue_first ++];
+		for (k=0; k<K; k++)
+		{
+			j = i + offset[k];
+			if (label[j] == node_num && r_cap[(j<<K_SHIFT) + (k^1)])
+			{
+				label[j] = label[i] + 1;
+				queue[queue_last ++] = j;
+			}
+		}
+	}
+
+	/* active blocks */
+	memset(block_active, 0, block_num_x*block_num_y);
+	for (y=0; y<height; y++)
+	{
+		by = y / block_size;
+		for (x=0, i=(y+1)*pwidth+1; x<width; x++, i++)
+		{
+			if (excess[i] > 0 && label[i] < node_num)
+			{
+				bx = x / block_size;
+				block_active[by*block_num_x + bx] = 1;
+				active_num ++;
+			}
+		}
+	}
+
+	return active_num;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	void GridGraph<captype,tcaptype,flowtype>::region_relabel(int x0, int x1, int y0, int y1, std::vector<int>& queue)
+{
+	int i, j, k, x, y, d;
+	size_t h;
+
+	/* the labels of the block are computed again from the nodes with a
+	   residual capacity to the sink and from the labels of the neighbours
+	   outside the block, in increasing order (buckets of equal labels) */
+	std::vector< std::vector<int> > buckets;
+	for (y=y0; y<y1; y++)
+	for (x=x0, i=(y+1)*pwidth+x0+1; x<x1; x++, i++)
+	{
+		d = (nodes[i].tr_cap < 0) ? 1 : node_num;
+		for (k=0; k<K; k++)
+		{
+			j = i + offset[k];
+			if (!r_cap[(i<<K_SHIFT) + k] || label[j] + 1 >= d) continue;
+			int xj = j % pwidth - 1;
+			int yj = j / pwidth - 1;
+			if (xj < x0 || xj >= x1 || yj < y0 || yj >= y1) d = label[j] + 1;
+		}
+		label[i] = d;
+		if (d < node_num)
+		{
+			if ((int)buckets.size() <= d) buckets.resize(d + 1);
+			buckets[d].push_back(i);
+		}
+	}
+
+	for (d=1; d<(int)buckets.size(); d++)
+	{
+		for (h=0; h<buckets[d].size(); h++)
+		{
+			i = buckets[d][h];
+			if (label[i] != d) continue;
+			for (k=0; k<K; k++)
+			{
+				j = i + offset[k];
+				if (label[j] <= d + 1 || !r_cap[(j<<K_SHIFT) + (k^1)]) continue;
+				x = j % pwidth - 1;
+				y = j / pwidth - 1;
+				if (x < x0 || x >= x1 || y < y0 || y >= y1) continue;
+				label[j] = d + 1;
+				if ((int)buckets.size() <= d + 1) buckets.resize(d + 2);
+				buckets[d + 1].push_back(j);
+			}
+		}
+	}
+
+	/* active nodes of the block */
+	queue.clear();
+	for (y=y0; y<y1; y++)
+	for (x=x0, i=(y+1)*pwidth+x0+1; x<x1; x++, i++)
+	{
+		if (excess[i] > 0 && label[i] < node_num) queue.push_back(i);
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype GridGraph<captype,tcaptype,flowtype>::discharge_block(int bx, int by, std::vector<int>& queue)
+{
+	int x0 = bx*block_size, x1 = x0 + block_size;
+	int y0 = by*block_size, y1 = y0 + block_size;
+	if (x1 > width)  x1 = width;
+	if (y1 > height) y1 = height;
+
+	int i, j, k, x, y, d;
+	int relabel_num = 0, block_node_num = (x1 - x0)*(y1 - y0);
+	size_t h;
+	arc_id a;
+	tcaptype delta;
+	flowtype pushed = 0;
+
+	queue.clear();
+	for (y=y0; y<y1; y++)
+	for (x=x0, i=(y+1)*pwidth+x0+1; x<x1; x++, i++)
+	{
+		if (excess[i] > 0 && label[i] < node_num) queue.push_back(i);
+	}
+
+	for (h=0; h<queue.size(); h++)
+	{
+		i = queue[h];
+		while (excess[i] > 0 && label[i] < node_num)
+		{
+			/* push to the sink */
+			if (nodes[i].tr_cap < 0 && label[i] == 1)
+			{
+				delta = (excess[i] < -nodes[i].tr_cap) ? excess[i] : -nodes[i].tr_cap;
+				excess[i] -= delta;
+				nodes[i].tr_cap += delta;
+				pushed += delta;
+			}
+
+			/* push to the neighbours */
+			for (k=0; k<K && excess[i]>0; k++)
+			{
+				a = (i<<K_SHIFT) + k;
+				if (!r_cap[a]) continue;
+				j = i + offset[k];
+				if (label[i] != label[j] + 1) continue;
+
+				delta = (excess[i] < r_cap[a]) ? excess[i] : r_cap[a];
+				r_cap[a] -= delta;
+				r_cap[(j<<K_SHIFT) + (k^1)] += delta;
+				excess[i] -= delta;
+				/* a node of the block which becomes active is queued, the
+				   other ones are processed with their own block */
+				if (!excess[j])
+				{
+					x = j % pwidth - 1;
+					y = j / pwidth - 1;
+					if (x >= x0 && x < x1 && y >= y0 && y < y1) queue.push_back(j);
+				}
+				excess[j] += delta;
+			}
+
+			/* relabel */
+			if (excess[i] > 0)
+			{
+				d = (nodes[i].tr_cap < 0) ? 1 : node_num;
+				for (k=0; k<K; k++)
+				{
+					if (r_cap[(i<<K_SHIFT) + k] && label[i + offset[k]] + 1 < d) d = label[i + offset[k]] + 1;
+				}
+				label[i] = d;
+
+				/* the labels raised one step at a time are replaced by the
+				   exact distances within the block */
+				if (++ relabel_num > block_node_num)
+				{
+					region_relabel(x0, x1, y0, y1, queue);
+					relabel_num = 0;
+					h = (size_t)-1;
+					break;
+				}
+			}
+		}
+	}
+
+	return pushed;
+}
+
+template <typename captype, typename tcaptype, typename flowtype>
+	flowtype GridGraph<captype,tcaptype,flowtype>::maxflow_parallel(int _block_size)
+{
+	int i, c;
+
+	if (_block_size < 2) { if (error_function) (*error_function)((char *)"The blocks must be at least 2x2 pixels!"); exit(1); }
+
+	if (!excess)
+	{
+		excess = (tcaptype*) malloc(node_num*sizeof(tcaptype));
+		label = (int*) malloc(node_num*sizeof(int));
+		if (!excess || !label) { if (error_function) (*error_function)((char *)"Not enough memory!"); exit(1); }
+	}
+	if (_block_size != block_size)
+	{
+		block_size = _block_size;
+		block_num_x = (width + block_size - 1) / block_size;
+		block_num_y = (height + block_size - 1) / block_size;
+		free(block_active);
+		block_active = (unsigned char*) malloc(block_num_x*block_num_y);
+		if (!block_active) { if (error_function) (*error_function)((char *)"Not enough memory!"); exit(1); }
+	}
+
+	/* saturate the source t-links */
+	for (i=0; i<node_num; i++)
+	{
+		if (nodes[i].tr_cap > 0)
+		{
+			excess[i] = nodes[i].tr_cap;
+			nodes[i].tr_cap = 0;
+		}
+		else excess[i] = 0;
+	}
+
+	while (global_relabel() > 0)
+	{
+		for (c=0; c<4; c++)
+		{
+			/* blocks (bx,by) with bx%2 == c%2 and by%2 == c/2 */
+			int bx0 = c % 2, by0 = c / 2;
+			int num_x = (block_num_x - bx0 + 1) / 2;
+			int num_y = (block_num_y - by0 + 1) / 2;
+			int b, num = num_x*num_y;
+			flowtype pushed = 0;
+
+#ifdef cimg_use_openmp
+#pragma omp parallel reduction(+:pushed)
+#endif
+			{
+				std::vector<int> queue;
+#ifdef cimg_use_openmp
+#pragma omp for schedule(dynamic)
+#endif
+				for (b=0; b<num; b++)
+				{
+					int bx = bx0 + 2*(b % num_x);
+					int by = by0 + 2*(b / num_x);
+					if (block_active[by*block_num_x + bx]) pushed += discharge_block(bx, by, queue);
+				}
+			}
+
+			flow += pushed;
+		}
+	}
+
+	/* move the remaining excess back to the source t-links */
+	for (i=0; i<node_num; i++)
+	{
+		nodes[i].tr_cap += excess[i];
+	}
+
+	return maxflow();
+}
@@ -0,0 +1,297 @@
+/* likelihood.h */
+/*
+	Gaussian likelihood of the feature vectors of a class of pixels.
+
+	The features of an image are stored in a single CImg<float> with one
+	channel per feature (dimx() x dimy() x 1 x N): each feature is a
+	contiguous plane of the image, in the same pixel order as the image.
+
+	The mean and the covariance of the class are estimated in double
+	precision, and the covariance is factored once as L*L^T (Cholesky).
+	The negative log-likelihood of a pixel is then
+		0.5*(log(det(C)) + |L^-1 (f - m)|^2)
+	where log(det(C)) = 2*sum(log(L_ii)), so that neither the determinant
+	nor the inverse of C are computed. L^-1 (f - m) is computed with a
+	forward substitution on blocks of pixels: the inner loops run over the
+	contiguous pixels of a block.
+
+	If the covariance is singular or nearly singular (for instance when a
+	feature is constant or two features are proportional in the class), a
+	small multiple of the identity is added to it before the factorisation
+	(see GetJitter()). A covariance which is not finite (NaN or infinite
+	features) cannot be factored with any jitter: the estimation gives up
+	and IsValid() returns false.
+
+	CImg.h must be included before this file.
+*/
+
+#ifndef __LIKELIHOOD_H__
+#define __LIKELIHOOD_H__
+
+#include <math.h>
+#include <vector>
+
+#ifdef cimg_use_openmp
+#include <omp.h>
+#endif
+
+
+class GaussianLikelihood
+{
+public:
+	/*!
+	 * \brief Estimate the Gaussian distribution of a class of pixels
+	 * \param features  the features of the image, one channel per feature
+	 * \param mask      the segmentation mask, same size as the image
+	 * \param white     true for the pixels where mask > 0, false for the other ones
+	 */
+	GaussianLikelihood(const CImg<float>& features, const CImg<float>& mask, bool white);
+
+	/*!
+	 * \brief Estimate the Gaussian distribution of a class of a multi-label segmentation
+	 * \param features  the features of the image, one channel per feature
+	 * \param labels    the label of each pixel, same size as the image
+	 * \param label     the label of the class
+	 */
+	GaussianLikelihood(const CImg<float>& features, const CImg<int>& labels, int label);
+
+	/*!
+	 * \brief Negative log-likelihood of every pixel, up to the constant N/2*log(2*pi)
+	 * \param features  the features of an image, with the same number of channels
+	 * \return an image of the size of features
+	 */
+	CImg<float> NegLogLikelihood(const CImg<float>& features) const;
+
+	// number of pixels of the class
+	unsigned int GetSampleNum() const { return m_sampleNum; }
+	// log of the determinant of the covariance (jitter included)
+	double GetLogDet() const { return m_logDet; }
+	// value added to the diagonal of the covariance, 0 if it was not needed
+	double GetJitter() const { return m_jitter; }
+	// false if the covariance could not be factored (features not finite),
+	// NegLogLikelihood() is then meaningless
+	bool IsValid() const { return m_valid; }
+
+private:
+	// mean, covariance and Cholesky factor of the pixels 'samples'
+	void Estimate(const CImg<float>& features, const std::vector<unsigned long>& samples);
+
+	// Cholesky factorisation of m_cov + jitter*I in m_chol,
+	// false if a pivot is not larger than tol
+	bool Factor(double jitter, double tol);
+
+	int					m_N;			// dimension of the features
+	unsigned int		m_sampleNum;	// number of pixels of the class
+	std::vector<double>	m_mean;			// mean (N)
+	std::vector<double>	m_cov;			// covariance (N x N, row-major)
+	std::vector<double>	m_chol;			// lower triangular factor (N x N, row-major)
+	std::vector<double>	m_invDiag;		// inverses of the diagonal of the factor
+	double				m_logDet;
+	double				m_jitter;
+	bool				m_valid;
+};
+
+
+
+///////////////////////////////////////
+// Implementation                    //
+///////////////////////////////////////
+
+// number of pixels of a block of the forward substitution
+#define LIKELIHOOD_BLOCK 256
+
+inline GaussianLikelihood::GaussianLikelihood(const CImg<float>& features, const CImg<float>& mask, bool white)
+	: m_N(features.dimv()),
+	  m_sampleNum(0),
+	  m_logDet(0),
+	  m_jitter(0),
+	  m_valid(true)
+{
+	const unsigned long P = (unsigned long)features.dimx()*features.dimy();
+	std::vector<unsigned long> samples;
+	for(unsigned long p = 0; p < P; p++)
+	{
+		if((mask.data[p] > 0) == white)
+			samples.push_back(p);
+	}
+	Estimate(features, samples);
+}
+
+inline GaussianLikelihood::GaussianLikelihood(const CImg<float>& features, const CImg<int>& labels, int label)
+	: m_N(features.dimv()),
+	  m_sampleNum(0),
+	  m_logDet(0),
+	  m_jitter(0),
+	  m_valid(true)
+{
+	const unsigned long P = (unsigned long)features.dimx()*features.dimy();
+	std::vector<unsigned long> samples;
+	for(unsigned long p = 0; p < P; p++)
+	{
+		if(labels.data[p] == label)
+			samples.push_back(p);
+	}
+	Estimate(features, samples);
+}
+
+inline void GaussianLikelihood::Estimate(const CImg<float>& features, const std::vector<unsigned long>& samples)
+{
+	const int N = m_N;
+	const unsigned long P = (unsigned long)features.dimx()*features.dimy();
+	unsigned long p;
+	int a, b;
+
+	m_sampleNum = samples.size();
+	const unsigned long S = samples.size();
+
+	m_mean.assign(N, 0.0);
+	m_cov.assign(N*N, 0.0);
+	m_chol.assign(N*N, 0.0);
+	m_invDiag.assign(N, 0.0);
+	if(S == 0)
+		return;
+
+	// the centred features of the class, one contiguous row per feature
+	std::vector<double> centred(N*S);
+	for(a = 0; a < N; a++)
+	{
+		const float *f = features.data + a*P;
+		double *c = &centred[a*S];
+		double sum = 0;
+		for(p = 0; p < S; p++)
+			sum += f[samples[p]];
+		m_mean[a] = sum/S;
+		for(p = 0; p < S; p++)
+			c[p] = f[samples[p]] - m_mean[a];
+	}
+
+	for(a = 0; a < N; a++)
+	{
+		for(b = 0; b <= a; b++)
+		{
+			const double *ca = &centred[a*S];
+			const double *cb = &centred[b*S];
+			double sum = 0;
+			for(p = 0; p < S; p++)
+				sum += ca[p]*cb[p];
+			m_cov[a*N + b] = m_cov[b*N + a] = sum/S;
+		}
+	}
+
+	// the pivots are compared to the mean variance: a pivot smaller than
+	// 1e-10 times the mean variance is at the level of the rounding errors
+	// of the features, and the jitter is increased tenfold until the
+	// factorisation succeeds (it does with jitter = trace/N). If it still
+	// fails beyond that, the covariance is not finite and no jitter helps.
+	double scale = 0;
+	for(a = 0; a < N; a++)
+		scale += m_cov[a*N + a];
+	scale = (scale > 0) ? scale/N : 1.0;
+	const double tol = 1e-10*scale;
+	if(!Factor(0, tol))
+	{
+		for(m_jitter = tol; !Factor(m_jitter, tol); m_jitter *= 10)
+		{
+			if(!(m_jitter <= 10*scale))
+			{
+				m_valid = false;
+				return;
+			}
+		}
+	}
+
+	for(a = 0; a < N; a++)
+	{
+		m_logDet += 2*log(m_chol[a*N + a]);
+		m_invDiag[a] = 1/m_chol[a*N + a];
+	}
+}
+
+inline bool GaussianLikelihood::Factor(double jitter, double tol)
+{
+	const int N = m_N;
+	for(int j = 0; j < N; j++)
+	{
+		double *lj = &m_chol[j*N];
+		double s = m_cov[j*N + j] + jitter;
+		for(int k = 0; k < j; k++)
+			s -= lj[k]*lj[k];
+		// also false for NaN
+		if(!(s > tol))
+			return false;
+		lj[j] = sqrt(s);
+		for(int i = j+1; i < N; i++)
+		{
+			double *li = &m_chol[i*N];
+			double t = m_cov[i*N + j];
+			for(int k = 0; k < j; k++)
+				t -= li[k]*lj[k];
+			li[j] = t/lj[j];
+		}
+	}
+	return true;
+}
+
+inline CImg<float> GaussianLikelihood::NegLogLikelihood(const CImg<float>& features) const
+{
+	const int N = m_N;
+	const long P = (long)features.dimx()*features.dimy();
+	const long numBlocks = (P + LIKELIHOOD_BLOCK - 1)/LIKELIHOOD_BLOCK;
+	CImg<float> out(features.dimx(), features.dimy());
+
+#ifdef cimg_use_openmp
+#pragma omp parallel
+#endif
+	{
+		// z = L^-1 (f - m) for the pixels of a block, one row per feature
+		std::vector<double> z(N*LIKELIHOOD_BLOCK);
+		double q[LIKELIHOOD_BLOCK];
+
+#ifdef cimg_use_openmp
+#pragma omp for schedule(static)
+#endif
+		for(long blk = 0; blk < numBlocks; blk++)
+		{
+			const long p0 = blk*LIKELIHOOD_BLOCK;
+			const int B = (P - p0 < LIKELIHOOD_BLOCK) ? (int)(P - p0) : LIKELIHOOD_BLOCK;
+			int p;
+
+			for(p = 0; p < B; p++)
+				q[p] = 0;
+
+			for(int r = 0; r < N; r++)
+			{
+				const float *f = features.data + r*P + p0;
+				const double *l = &m_chol[r*N];
+				const double m = m_mean[r];
+				double *zr = &z[r*LIKELIHOOD_BLOCK];
+
+				for(p = 0; p < B; p++)
+					zr[p] = f[p] - m;
+				for(int c = 0; c < r; c++)
+				{
+					const double lc = l[c];
+					const double *zc = &z[c*LIKELIHOOD_BLOCK];
+					for(p = 0; p < B; p++)
+						zr[p] -= lc*zc[p];
+				}
+				const double d = m_invDiag[r];
+				for(p = 0; p < B; p++)
+				{
+					zr[p] *= d;
+					q[p] += zr[p]*zr[p];
+				}
+			}
+
+			for(p = 0; p < B; p++)
+				out.data[p0 + p] = (float)(0.5*(m_logDet + q[p]));
+		}
+	}
+
+	return out;
+}
+
+#undef LIKELIHOOD_BLOCK
+
+
+#endif
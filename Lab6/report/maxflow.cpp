@@ -0,0 +1,695 @@
+/* maxflow.cpp */
+
+
+#include <stdio.h>
+#include "graph.h"
+#include "instances.inc"
+
+
+/*
+	special constants for node->parent
+	(0 means no parent, arcs start at FIRST_ARC)
+*/
+#define TERMINAL 1		/* to terminal */
+#define ORPHAN   2		/* orphan */
+
+
+#define INFINITE_D ((int)(((unsigned)-1)/2))		/* infinite distance to the terminal */
+
+/***********************************************************************/
+
+/*
+	Functions for processing active list.
+	i->next is the next node in the list
+	(or i, if i is the last node in the list).
+	i->next is -1 iff i is not in the list.
+
+	There are two queues. Active nodes are added
+	to the end of the second queue and read from
+	the front of the first queue. If the first queue
+	is empty, it is replaced by the second queue
+	(and the second queue becomes empty).
+*/
+
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline void Graph<captype,tcaptype,flowtype>::set_active(int i)
+{
+	if (nodes[i].next < 0)
+	{
+		/* it's not in the list yet */
+		if (queue_last[1] >= 0) nodes[queue_last[1]].next = i;
+		else                    queue_first[1]            = i;
+		queue_last[1] = i;
+		nodes[i].next = i;
+	}
+}
+
+/*
+	Returns the next active node.
+	If it is connected to the sink, it stays in the list,
+	otherwise it is removed from the list
+*/
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline int Graph<captype,tcaptype,flowtype>::next_active()
+{
+	int i;
+
+	while ( 1 )
+	{
+		if ((i=queue_first[0]) < 0)
+		{
+			queue_first[0] = i = queue_first[1];
+			queue_last[0]  = queue_last[1];
+			queue_first[1] = -1;
+			queue_last[1]  = -1;
+			if (i < 0) return -1;
+		}
+
+		/* remove it from the active list */
+		if (nodes[i].next == i) queue_first[0] = queue_last[0] = -1;
+		else                    queue_first[0] = nodes[i].next;
+		nodes[i].next = -1;
+
+		/* a node in the list is active iff it has a parent */
+		if (nodes[i].parent) return i;
+	}
+}
+
+/***********************************************************************/
+
+/*
+	The items of the list of orphans are taken from the array nodeptrs
+	and given back to it when the orphan is processed. The array only
+	grows: maxflow() does not allocate memory once it is large enough.
+*/
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline int Graph<captype,tcaptype,flowtype>::new_nodeptr()
+{
+	if (!nodeptr_free) reallocate_nodeptrs();
+	int np = nodeptr_free;
+	nodeptr_free = nodeptrs[np].next;
+	return np;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline void Graph<captype,tcaptype,flowtype>::delete_nodeptr(int np)
+{
+	nodeptrs[np].next = nodeptr_free;
+	nodeptr_free = np;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline void Graph<captype,tcaptype,flowtype>::set_orphan_front(int i)
+{
+	int np;
+	nodes[i].parent = ORPHAN;
+	np = new_nodeptr();
+	nodeptrs[np].ptr = i;
+	nodeptrs[np].next = orphan_first;
+	orphan_first = np;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline void Graph<captype,tcaptype,flowtype>::set_orphan_rear(int i)
+{
+	int np;
+	nodes[i].parent = ORPHAN;
+	np = new_nodeptr();
+	nodeptrs[np].ptr = i;
+	if (orphan_last) nodeptrs[orphan_last].next = np;
+	else             orphan_first               = np;
+	orphan_last = np;
+	nodeptrs[np].next = 0;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline void Graph<captype,tcaptype,flowtype>::add_to_changed_list(int i)
+{
+	if (changed_list && !nodes[i].is_in_changed_list)
+	{
+		node_id* ptr = changed_list->New();
+		*ptr = i;
+		nodes[i].is_in_changed_list = true;
+	}
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::maxflow_init()
+{
+	int i;
+
+	queue_first[0] = queue_last[0] = -1;
+	queue_first[1] = queue_last[1] = -1;
+	orphan_first = 0;
+
+	TIME = 0;
+
+	for (i=0; i<node_num; i++)
+	{
+		nodes[i].next = -1;
+		nodes[i].is_marked = 0;
+		nodes[i].is_in_changed_list = 0;
+		nodes[i].TS = TIME;
+		if (nodes[i].tr_cap > 0)
+		{
+			/* i is connected to the source */
+			nodes[i].is_sink = 0;
+			nodes[i].parent = TERMINAL;
+			set_active(i);
+			nodes[i].DIST = 1;
+		}
+		else if (nodes[i].tr_cap < 0)
+		{
+			/* i is connected to the sink */
+			nodes[i].is_sink = 1;
+			nodes[i].parent = TERMINAL;
+			set_active(i);
+			nodes[i].DIST = 1;
+		}
+		else
+		{
+			nodes[i].parent = 0;
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::maxflow_reuse_trees_init()
+{
+	int i, j;
+	int queue = queue_first[1];
+	arc_id a;
+	int np;
+
+	queue_first[0] = queue_last[0] = -1;
+	queue_first[1] = queue_last[1] = -1;
+	orphan_first = orphan_last = 0;
+
+	TIME ++;
+
+	while ((i=queue) >= 0)
+	{
+		queue = nodes[i].next;
+		if (queue == i) queue = -1;
+		nodes[i].next = -1;
+		nodes[i].is_marked = 0;
+		set_active(i);
+
+		if (nodes[i].tr_cap == 0)
+		{
+			if (nodes[i].parent) set_orphan_rear(i);
+			continue;
+		}
+
+		if (nodes[i].tr_cap > 0)
+		{
+			if (!nodes[i].parent || nodes[i].is_sink)
+			{
+				nodes[i].is_sink = 0;
+				for (a=nodes[i].first; a; a=arcs[a].next)
+				{
+					j = arcs[a].head;
+					if (!nodes[j].is_marked)
+					{
+						if (nodes[j].parent == (a^1)) set_orphan_rear(j);
+						if (nodes[j].parent && nodes[j].is_sink && arcs[a].r_cap > 0) set_active(j);
+					}
+				}
+				add_to_changed_list(i);
+			}
+		}
+		else
+		{
+			if (!nodes[i].parent || !nodes[i].is_sink)
+			{
+				nodes[i].is_sink = 1;
+				for (a=nodes[i].first; a; a=arcs[a].next)
+				{
+					j = arcs[a].head;
+					if (!nodes[j].is_marked)
+					{
+						if (nodes[j].parent == (a^1)) set_orphan_rear(j);
+						if (nodes[j].parent && !nodes[j].is_sink && arcs[a^1].r_cap > 0) set_active(j);
+					}
+				}
+				add_to_changed_list(i);
+			}
+		}
+		nodes[i].parent = TERMINAL;
+		nodes[i].TS = TIME;
+		nodes[i].DIST = 1;
+	}
+
+	//test_consistency();
+
+	/* adoption */
+	while ((np=orphan_first))
+	{
+		orphan_first = nodeptrs[np].next;
+		i = nodeptrs[np].ptr;
+		delete_nodeptr(np);
+		if (!orphan_first) orphan_last = 0;
+		if (nodes[i].is_sink) process_sink_orphan(i);
+		else                  process_source_orphan(i);
+	}
+	/* adoption end */
+
+	//test_consistency();
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::augment(arc_id middle_arc)
+{
+	int i;
+	arc_id a;
+	tcaptype bottleneck;
+
+
+	/* 1. Finding bottleneck capacity */
+	/* 1a - the source tree */
+	bottleneck = arcs[middle_arc].r_cap;
+	for (i=arcs[middle_arc^1].head; ; i=arcs[a].head)
+	{
+		a = nodes[i].parent;
+		if (a == TERMINAL) break;
+		if (bottleneck > arcs[a^1].r_cap) bottleneck = arcs[a^1].r_cap;
+	}
+	if (bottleneck > nodes[i].tr_cap) bottleneck = nodes[i].tr_cap;
+	/* 1b - the sink tree */
+	for (i=arcs[middle_arc].head; ; i=arcs[a].head)
+	{
+		a = nodes[i].parent;
+		if (a == TERMINAL) break;
+		if (bottleneck > arcs[a].r_cap) bottleneck = arcs[a].r_cap;
+	}
+	if (bottleneck > - nodes[i].tr_cap) bottleneck = - nodes[i].tr_cap;
+
+
+	/* 2. Augmenting */
+	/* 2a - the source tree */
+	arcs[middle_arc^1].r_cap += bottleneck;
+	arcs[middle_arc].r_cap -= bottleneck;
+	for (i=arcs[middle_arc^1].head; ; i=arcs[a].head)
+	{
+		a = nodes[i].parent;
+		if (a == TERMINAL) break;
+		arcs[a].r_cap += bottleneck;
+		arcs[a^1].r_cap -= bottleneck;
+		if (!arcs[a^1].r_cap)
+		{
+			set_orphan_front(i); // add i to the beginning of the adoption list
+		}
+	}
+	nodes[i].tr_cap -= bottleneck;
+	if (!nodes[i].tr_cap)
+	{
+		set_orphan_front(i); // add i to the beginning of the adoption list
+	}
+	/* 2b - the sink tree */
+	for (i=arcs[middle_arc].head; ; i=arcs[a].head)
+	{
+		a = nodes[i].parent;
+		if (a == TERMINAL) break;
+		arcs[a^1].r_cap += bottleneck;
+		arcs[a].r_cap -= bottleneck;
+		if (!arcs[a].r_cap)
+		{
+			set_orphan_front(i); // add i to the beginning of the adoption list
+		}
+	}
+	nodes[i].tr_cap += bottleneck;
+	if (!nodes[i].tr_cap)
+	{
+		set_orphan_front(i); // add i to the beginning of the adoption list
+	}
+
+
+	flow += bottleneck;
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::process_source_orphan(int i)
+{
+	int j;
+	arc_id a0, a0_min = 0, a;
+	int d, d_min = INFINITE_D;
+
+	/* trying to find a new parent */
+	for (a0=nodes[i].first; a0; a0=arcs[a0].next)
+	if (arcs[a0^1].r_cap)
+	{
+		j = arcs[a0].head;
+		if (!nodes[j].is_sink && (a=nodes[j].parent))
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (nodes[j].TS == TIME)
+				{
+					d += nodes[j].DIST;
+					break;
+				}
+				a = nodes[j].parent;
+				d ++;
+				if (a==TERMINAL)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j = arcs[a].head;
+			}
+			if (d<INFINITE_D) /* j originates from the source - done */
+			{
+				if (d<d_min)
+				{
+					a0_min = a0;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=arcs[a0].head; nodes[j].TS!=TIME; j=arcs[nodes[j].parent].head)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = d --;
+				}
+			}
+		}
+	}
+
+	if ((nodes[i].parent = a0_min))
+	{
+		nodes[i].TS = TIME;
+		nodes[i].DIST = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		add_to_changed_list(i);
+
+		/* process neighbors */
+		for (a0=nodes[i].first; a0; a0=arcs[a0].next)
+		{
+			j = arcs[a0].head;
+			if (!nodes[j].is_sink && (a=nodes[j].parent))
+			{
+				if (arcs[a0^1].r_cap) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && arcs[a].head==i)
+				{
+					set_orphan_rear(j); // add j to the end of the adoption list
+				}
+			}
+		}
+	}
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::process_sink_orphan(int i)
+{
+	int j;
+	arc_id a0, a0_min = 0, a;
+	int d, d_min = INFINITE_D;
+
+	/* trying to find a new parent */
+	for (a0=nodes[i].first; a0; a0=arcs[a0].next)
+	if (arcs[a0].r_cap)
+	{
+		j = arcs[a0].head;
+		if (nodes[j].is_sink && (a=nodes[j].parent))
+		{
+			/* checking the origin of j */
+			d = 0;
+			while ( 1 )
+			{
+				if (nodes[j].TS == TIME)
+				{
+					d += nodes[j].DIST;
+					break;
+				}
+				a = nodes[j].parent;
+				d ++;
+				if (a==TERMINAL)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = 1;
+					break;
+				}
+				if (a==ORPHAN) { d = INFINITE_D; break; }
+				j = arcs[a].head;
+			}
+			if (d<INFINITE_D) /* j originates from the sink - done */
+			{
+				if (d<d_min)
+				{
+					a0_min = a0;
+					d_min = d;
+				}
+				/* set marks along the path */
+				for (j=arcs[a0].head; nodes[j].TS!=TIME; j=arcs[nodes[j].parent].head)
+				{
+					nodes[j].TS = TIME;
+					nodes[j].DIST = d --;
+				}
+			}
+		}
+	}
+
+	if ((nodes[i].parent = a0_min))
+	{
+		nodes[i].TS = TIME;
+		nodes[i].DIST = d_min + 1;
+	}
+	else
+	{
+		/* no parent is found */
+		add_to_changed_list(i);
+
+		/* process neighbors */
+		for (a0=nodes[i].first; a0; a0=arcs[a0].next)
+		{
+			j = arcs[a0].head;
+			if (nodes[j].is_sink && (a=nodes[j].parent))
+			{
+				if (arcs[a0].r_cap) set_active(j);
+				if (a!=TERMINAL && a!=ORPHAN && arcs[a].head==i)
+				{
+					set_orphan_rear(j); // add j to the end of the adoption list
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************************/
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	flowtype Graph<captype,tcaptype,flowtype>::maxflow(bool reuse_trees, Block<node_id>* _changed_list)
+{
+	int i, j, current_node = -1;
+	arc_id a;
+	int np, np_next;
+
+	changed_list = _changed_list;
+	if (maxflow_iteration == 0 && reuse_trees) { if (error_function) (*error_function)("reuse_trees cannot be used in the first call to maxflow()!"); exit(1); }
+	if (changed_list && !reuse_trees) { if (error_function) (*error_function)("changed_list cannot be used without reuse_trees!"); exit(1); }
+
+	if (reuse_trees) maxflow_reuse_trees_init();
+	else             maxflow_init();
+
+	// main loop
+	while ( 1 )
+	{
+		// test_consistency(current_node);
+
+		if ((i=current_node) >= 0)
+		{
+			nodes[i].next = -1; /* remove active flag */
+			if (!nodes[i].parent) i = -1;
+		}
+		if (i < 0)
+		{
+			if ((i = next_active()) < 0) break;
+		}
+
+		/* growth */
+		if (!nodes[i].is_sink)
+		{
+			/* grow source tree */
+			for (a=nodes[i].first; a; a=arcs[a].next)
+			if (arcs[a].r_cap)
+			{
+				j = arcs[a].head;
+				if (!nodes[j].parent)
+				{
+					nodes[j].is_sink = 0;
+					nodes[j].parent = a^1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+					set_active(j);
+					add_to_changed_list(j);
+				}
+				else if (nodes[j].is_sink) break;
+				else if (nodes[j].TS <= nodes[i].TS &&
+				         nodes[j].DIST > nodes[i].DIST)
+				{
+					/* heuristic - trying to make the distance from j to the source shorter */
+					nodes[j].parent = a^1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+				}
+			}
+		}
+		else
+		{
+			/* grow sink tree */
+			for (a=nodes[i].first; a; a=arcs[a].next)
+			if (arcs[a^1].r_cap)
+			{
+				j = arcs[a].head;
+				if (!nodes[j].parent)
+				{
+					nodes[j].is_sink = 1;
+					nodes[j].parent = a^1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+					set_active(j);
+					add_to_changed_list(j);
+				}
+				else if (!nodes[j].is_sink) { a = a^1; break; }
+				else if (nodes[j].TS <= nodes[i].TS &&
+				         nodes[j].DIST > nodes[i].DIST)
+				{
+					/* heuristic - trying to make the distance from j to the sink shorter */
+					nodes[j].parent = a^1;
+					nodes[j].TS = nodes[i].TS;
+					nodes[j].DIST = nodes[i].DIST + 1;
+				}
+			}
+		}
+
+		TIME ++;
+
+		if (a)
+		{
+			nodes[i].next = i; /* set active flag */
+			current_node = i;
+
+			/* augmentation */
+			augment(a);
+			/* augmentation end */
+
+			/* adoption */
+			while ((np=orphan_first))
+			{
+				np_next = nodeptrs[np].next;
+				nodeptrs[np].next = 0;
+
+				while ((np=orphan_first))
+				{
+					orphan_first = nodeptrs[np].next;
+					i = nodeptrs[np].ptr;
+					delete_nodeptr(np);
+					if (!orphan_first) orphan_last = 0;
+					if (nodes[i].is_sink) process_sink_orphan(i);
+					else                  process_source_orphan(i);
+				}
+
+				orphan_first = np_next;
+			}
+			/* adoption end */
+		}
+		else current_node = -1;
+	}
+	// test_consistency();
+
+	maxflow_iteration ++;
+	return flow;
+}
+
+/***********************************************************************/
+
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::test_consistency(int current_node)
+{
+	int i;
+	arc_id a;
+	int r;
+	int num1 = 0, num2 = 0;
+
+	// test whether all nodes i with nodes[i].next!=-1 are indeed in the queue
+	for (i=0; i<node_num; i++)
+	{
+		if (nodes[i].next >= 0 || i==current_node) num1 ++;
+	}
+	for (r=0; r<3; r++)
+	{
+		i = (r == 2) ? current_node : queue_first[r];
+		if (i >= 0)
+		for ( ; ; i=nodes[i].next)
+		{
+			num2 ++;
+			if (nodes[i].next == i)
+			{
+				if (r<2) assert(i == queue_last[r]);
+				else     assert(i == current_node);
+				break;
+			}
+		}
+	}
+	assert(num1 == num2);
+
+	for (i=0; i<node_num; i++)
+	{
+		int p = nodes[i].parent;
+		// test whether all edges in seach trees are non-saturated
+		if (p == 0) {}
+		else if (p == ORPHAN) {}
+		else if (p == TERMINAL)
+		{
+			if (!nodes[i].is_sink) assert(nodes[i].tr_cap > 0);
+			else                   assert(nodes[i].tr_cap < 0);
+		}
+		else
+		{
+			if (!nodes[i].is_sink) assert (arcs[p^1].r_cap > 0);
+			else                   assert (arcs[p].r_cap > 0);
+		}
+		// test whether passive nodes in search trees have neighbors in
+		// a different tree through non-saturated edges
+		if (p && nodes[i].next < 0)
+		{
+			if (!nodes[i].is_sink)
+			{
+				assert(nodes[i].tr_cap >= 0);
+				for (a=nodes[i].first; a; a=arcs[a].next)
+				{
+					if (arcs[a].r_cap > 0) assert(nodes[arcs[a].head].parent && !nodes[arcs[a].head].is_sink);
+				}
+			}
+			else
+			{
+				assert(nodes[i].tr_cap <= 0);
+				for (a=nodes[i].first; a; a=arcs[a].next)
+				{
+					if (arcs[a^1].r_cap > 0) assert(nodes[arcs[a].head].parent && nodes[arcs[a].head].is_sink);
+				}
+			}
+		}
+		// test marking invariants
+		if (p && p!=ORPHAN && p!=TERMINAL)
+		{
+			assert(nodes[i].TS <= nodes[arcs[p].head].TS);
+			if (nodes[i].TS == nodes[arcs[p].head].TS) assert(nodes[i].DIST > nodes[arcs[p].head].DIST);
+		}
+	}
+}
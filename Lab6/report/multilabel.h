@@ -0,0 +1,398 @@
+/* multilabel.h */
+/*
+	Multi-label segmentation with the Potts model
+
+		E(l) = sum_p D_p(l_p) + beta * #{neighbours p,q : l_p != l_q}
+
+	on the 8-connected pixel grid (the neighbourhood of BuildGraph() in
+	tp6students.cpp), minimised with the alpha-expansion and the
+	alpha-beta-swap moves of
+
+		"Fast Approximate Energy Minimization via Graph Cuts."
+		Yuri Boykov, Olga Veksler and Ramin Zabih.
+		IEEE Transactions on Pattern Analysis and Machine Intelligence (PAMI),
+		November 2001
+
+	Each move is a binary graph cut computed with Graph: a node per pixel
+	which may change its label, the SOURCE segment meaning alpha. A move is
+	only applied if it lowers the energy, computed again in double
+	precision, so that the energy never increases with the rounding errors
+	of the float flow.
+
+	The graphs are allocated once (one per thread) and reset() between the
+	moves, so that their memory is reused for all the labels.
+
+	Two swap moves on disjoint label pairs {a,b} and {c,d} are independent:
+	they change disjoint sets of pixels, and a neighbour of an {a,b} pixel
+	whose label changes between c and d costs beta whether the pixel takes
+	a or b. A swap cycle is thus made of K-1 rounds of K/2 disjoint pairs
+	(round-robin tournament), the pairs of a round being solved in parallel
+	with OpenMP. All the expansion moves change the same pixels, so they
+	are computed one after the other.
+
+	CImg.h and graph.h must be included before this file.
+*/
+
+#ifndef __MULTILABEL_H__
+#define __MULTILABEL_H__
+
+#include <vector>
+
+#ifdef cimg_use_openmp
+#include <omp.h>
+#endif
+
+
+class PottsSegmentation
+{
+public:
+	typedef Graph<float,float,float> GraphType;
+
+	/*!
+	 * \brief Potts energy of a multi-label segmentation
+	 * \param dataCost  the cost D_p(k) of each label k for each pixel, one channel per label
+	 * \param beta      the weight of the pairs of neighbours with different labels
+	 */
+	PottsSegmentation(const CImg<float>& dataCost, float beta);
+	~PottsSegmentation();
+
+	// number of labels
+	int GetLabelNum() const { return m_K; }
+
+	/*!
+	 * \brief Energy of a segmentation
+	 * \param labels  the label of each pixel, in [0, GetLabelNum())
+	 */
+	double Energy(const CImg<int>& labels) const;
+
+	/*!
+	 * \brief Alpha-expansion: expand each label in turn until no move lowers the energy
+	 * \param labels     the initial segmentation, overwritten with the result
+	 * \param maxCycles  maximum number of cycles over all the labels
+	 * \return the number of cycles
+	 */
+	int Expansion(CImg<int>& labels, int maxCycles = 10);
+
+	/*!
+	 * \brief Alpha-beta-swap: swap each pair of labels in turn until no move lowers the energy
+	 * \param labels     the initial segmentation, overwritten with the result
+	 * \param maxCycles  maximum number of cycles over all the pairs of labels
+	 * \return the number of cycles
+	 */
+	int Swap(CImg<int>& labels, int maxCycles = 10);
+
+private:
+	// expansion move of 'alpha', true if the energy decreased
+	bool ExpandLabel(CImg<int>& labels, int alpha, double& energy);
+	// swap move of 'alpha' and 'beta': reads 'labels', writes the pixels of
+	// the two labels in 'result', true if the energy decreased
+	bool SwapLabels(const CImg<int>& labels, int alpha, int beta, GraphType *g, CImg<int>& result);
+
+	// graph of the calling thread
+	GraphType *GetGraph();
+
+	const CImg<float>&			m_dataCost;
+	int							m_dimX, m_dimY, m_K;
+	float						m_beta;
+	std::vector<int>			m_node;		// node of each pixel in the graph of the current move, -1 if none
+	std::vector<GraphType*>		m_graphs;	// one graph per thread, reused by all the moves
+};
+
+
+
+///////////////////////////////////////
+// Implementation                    //
+///////////////////////////////////////
+
+// the neighbours (x+dx,y+dy) of a pixel which come after it, so that each
+// pair of neighbours is visited once
+static const int POTTS_NEIGHBOUR_NUM = 4;
+static const int POTTS_DX[POTTS_NEIGHBOUR_NUM] = { 1, 0, 1, -1 };
+static const int POTTS_DY[POTTS_NEIGHBOUR_NUM] = { 0, 1, 1,  1 };
+
+inline PottsSegmentation::PottsSegmentation(const CImg<float>& dataCost, float beta)
+	: m_dataCost(dataCost),
+	  m_dimX(dataCost.dimx()),
+	  m_dimY(dataCost.dimy()),
+	  m_K(dataCost.dimv()),
+	  m_beta(beta),
+	  m_node(dataCost.dimx()*dataCost.dimy(), -1)
+{
+	int numThreads = 1;
+#ifdef cimg_use_openmp
+	numThreads = omp_get_max_threads();
+#endif
+	m_graphs.assign(numThreads, (GraphType*)NULL);
+}
+
+inline PottsSegmentation::~PottsSegmentation()
+{
+	for(unsigned int t = 0; t < m_graphs.size(); t++)
+		delete m_graphs[t];
+}
+
+inline PottsSegmentation::GraphType *PottsSegmentation::GetGraph()
+{
+	int t = 0;
+#ifdef cimg_use_openmp
+	t = omp_get_thread_num();
+#endif
+	// the first graph is sized for a whole image, the other ones grow as needed
+	if(!m_graphs[t])
+	{
+		int P = m_dimX*m_dimY;
+		m_graphs[t] = (t == 0) ? new GraphType(P, 4*P) : new GraphType(P/m_K, 4*P/m_K);
+	}
+	return m_graphs[t];
+}
+
+inline double PottsSegmentation::Energy(const CImg<int>& labels) const
+{
+	const long P = (long)m_dimX*m_dimY;
+	double data = 0;
+	long cut = 0;
+
+	for(int y = 0; y < m_dimY; y++)
+	{
+		for(int x = 0; x < m_dimX; x++)
+		{
+			int l = labels(x,y);
+			data += m_dataCost.data[l*P + y*m_dimX + x];
+			for(int k = 0; k < POTTS_NEIGHBOUR_NUM; k++)
+			{
+				int xq = x + POTTS_DX[k], yq = y + POTTS_DY[k];
+				if(xq < 0 || xq >= m_dimX || yq >= m_dimY)
+					continue;
+				if(labels(xq,yq) != l)
+					cut++;
+			}
+		}
+	}
+
+	return data + (double)m_beta*cut;
+}
+
+inline bool PottsSegmentation::ExpandLabel(CImg<int>& labels, int alpha, double& energy)
+{
+	const long P = (long)m_dimX*m_dimY;
+	const float *Dalpha = m_dataCost.data + alpha*P;
+	GraphType *g = GetGraph();
+	int p, n = 0;
+
+	// a node for each pixel which is not labelled alpha: SOURCE takes alpha,
+	// SINK keeps the current label
+	for(p = 0; p < P; p++)
+		m_node[p] = (labels.data[p] == alpha) ? -1 : n++;
+	if(n == 0)
+		return false;
+
+	g->reset();
+	g->add_node(n);
+	for(p = 0; p < P; p++)
+	{
+		if(m_node[p] >= 0)
+			g->add_tweights(m_node[p], m_dataCost.data[labels.data[p]*P + p], Dalpha[p]);
+	}
+
+	for(int y = 0; y < m_dimY; y++)
+	{
+		for(int x = 0; x < m_dimX; x++)
+		{
+			p = y*m_dimX + x;
+			for(int k = 0; k < POTTS_NEIGHBOUR_NUM; k++)
+			{
+				int xq = x + POTTS_DX[k], yq = y + POTTS_DY[k];
+				if(xq < 0 || xq >= m_dimX || yq >= m_dimY)
+					continue;
+				int q = yq*m_dimX + xq;
+				int i = m_node[p], j = m_node[q];
+
+				if(i < 0 && j < 0)
+					continue;
+				else if(j < 0)
+					// q is alpha: beta if p keeps its label
+					g->add_tweights(i, m_beta, 0);
+				else if(i < 0)
+					g->add_tweights(j, m_beta, 0);
+				else if(labels.data[p] == labels.data[q])
+					// 0 if both keep their label or both take alpha, beta otherwise
+					g->add_edge(i, j, m_beta, m_beta);
+				else
+				{
+					// beta unless both take alpha: beta if p keeps its label,
+					// and beta on the arc p->q if p takes alpha and q does not
+					g->add_tweights(i, m_beta, 0);
+					g->add_edge(i, j, m_beta, 0);
+				}
+			}
+		}
+	}
+
+	g->maxflow();
+
+	CImg<int> expanded(labels);
+	for(p = 0; p < P; p++)
+	{
+		if(m_node[p] >= 0 && g->what_segment(m_node[p]) == GraphType::SOURCE)
+			expanded.data[p] = alpha;
+	}
+	double e = Energy(expanded);
+	if(e >= energy)
+		return false;
+
+	labels = expanded;
+	energy = e;
+	return true;
+}
+
+inline int PottsSegmentation::Expansion(CImg<int>& labels, int maxCycles)
+{
+	double energy = Energy(labels);
+	int cycle;
+
+	for(cycle = 0; cycle < maxCycles; cycle++)
+	{
+		bool decreased = false;
+		for(int alpha = 0; alpha < m_K; alpha++)
+		{
+			if(ExpandLabel(labels, alpha, energy))
+				decreased = true;
+		}
+		if(!decreased)
+			break;
+	}
+
+	return (cycle < maxCycles) ? cycle + 1 : cycle;
+}
+
+inline bool PottsSegmentation::SwapLabels(const CImg<int>& labels, int alpha, int beta, GraphType *g, CImg<int>& result)
+{
+	const long P = (long)m_dimX*m_dimY;
+	const float *Dalpha = m_dataCost.data + alpha*P;
+	const float *Dbeta = m_dataCost.data + beta*P;
+	std::vector<int> pixels;
+	int p, h, n = 0;
+
+	// a node for each pixel labelled alpha or beta: SOURCE takes alpha, SINK
+	// takes beta. The neighbours with other labels cost beta in both cases
+	// and are left out. m_node is only written for the pixels of the pair,
+	// which do not belong to the other pairs of the round.
+	for(p = 0; p < P; p++)
+	{
+		if(labels.data[p] == alpha || labels.data[p] == beta)
+		{
+			m_node[p] = n++;
+			pixels.push_back(p);
+		}
+	}
+	if(n == 0)
+		return false;
+
+	g->reset();
+	g->add_node(n);
+	double before = 0, after = 0;
+	for(h = 0; h < n; h++)
+	{
+		p = pixels[h];
+		g->add_tweights(h, Dbeta[p], Dalpha[p]);
+		before += (labels.data[p] == alpha) ? Dalpha[p] : Dbeta[p];
+	}
+	for(h = 0; h < n; h++)
+	{
+		p = pixels[h];
+		int x = p % m_dimX, y = p / m_dimX;
+		for(int k = 0; k < POTTS_NEIGHBOUR_NUM; k++)
+		{
+			int xq = x + POTTS_DX[k], yq = y + POTTS_DY[k];
+			if(xq < 0 || xq >= m_dimX || yq >= m_dimY)
+				continue;
+			int q = yq*m_dimX + xq;
+			if(labels.data[q] != alpha && labels.data[q] != beta)
+				continue;
+			g->add_edge(h, m_node[q], m_beta, m_beta);
+			if(labels.data[q] != labels.data[p])
+				before += m_beta;
+		}
+	}
+
+	g->maxflow();
+
+	// energy of the move (without the neighbours with other labels)
+	for(h = 0; h < n; h++)
+	{
+		p = pixels[h];
+		result.data[p] = (g->what_segment(h) == GraphType::SOURCE) ? alpha : beta;
+		after += (result.data[p] == alpha) ? Dalpha[p] : Dbeta[p];
+	}
+	for(h = 0; h < n; h++)
+	{
+		p = pixels[h];
+		int x = p % m_dimX, y = p / m_dimX;
+		for(int k = 0; k < POTTS_NEIGHBOUR_NUM; k++)
+		{
+			int xq = x + POTTS_DX[k], yq = y + POTTS_DY[k];
+			if(xq < 0 || xq >= m_dimX || yq >= m_dimY)
+				continue;
+			int q = yq*m_dimX + xq;
+			if((labels.data[q] == alpha || labels.data[q] == beta) && result.data[q] != result.data[p])
+				after += m_beta;
+		}
+	}
+
+	if(after < before)
+		return true;
+
+	for(h = 0; h < n; h++)
+		result.data[pixels[h]] = labels.data[pixels[h]];
+	return false;
+}
+
+inline int PottsSegmentation::Swap(CImg<int>& labels, int maxCycles)
+{
+	// round-robin tournament: with an even number of players (a dummy label
+	// m_K when m_K is odd), player 0 stays and the other ones rotate, so that
+	// each round is made of disjoint pairs and each pair plays once
+	int M = (m_K % 2) ? m_K + 1 : m_K;
+	CImg<int> result(labels);
+	int cycle;
+
+	for(cycle = 0; cycle < maxCycles; cycle++)
+	{
+		bool decreased = false;
+		for(int round = 0; round < M-1; round++)
+		{
+			std::vector< std::pair<int,int> > pairs;
+			for(int k = 0; k < M/2; k++)
+			{
+				int a = (k == 0) ? 0 : (round + k) % (M-1) + 1;
+				int b = (round + M-1 - k) % (M-1) + 1;
+				if(a < m_K && b < m_K)
+					pairs.push_back(std::make_pair(a, b));
+			}
+
+			int numPairs = pairs.size();
+			int numDecreased = 0;
+#ifdef cimg_use_openmp
+#pragma omp parallel for schedule(dynamic) reduction(+:numDecreased)
+#endif
+			for(int k = 0; k < numPairs; k++)
+			{
+				if(SwapLabels(labels, pairs[k].first, pairs[k].second, GetGraph(), result))
+					numDecreased++;
+			}
+
+			if(numDecreased > 0)
+			{
+				labels = result;
+				decreased = true;
+			}
+		}
+		if(!decreased)
+			break;
+	}
+
+	return (cycle < maxCycles) ? cycle + 1 : cycle;
+}
+
+
+#endif
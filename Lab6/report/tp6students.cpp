@@ -0,0 +1,780 @@
+#include <stdio.h>
+#include "graph.h"
+#include "gridgraph.h"
+#include "CImg.h" //relative path of the CImg file
+
+/* the namespace permits to use directly CImg<float> instead of having to specify
+
+* cimg_library::CImg<float> each time an image is used
+
+*/
+
+using namespace cimg_library;
+
+#include "likelihood.h"
+#include "multilabel.h"
+
+#ifdef min
+#undef min
+#endif
+
+#ifdef max
+#undef max
+#endif
+
+#define _USE_MATH_DEFINES //defines the value for pi
+
+#include "math.h" //mathematical functions (exponential, logarithm ...)
+
+#include <iostream> //for input and output on command line
+
+#include <vector>
+
+#include <sstream>
+
+#include <algorithm>
+
+#include <map>
+
+#ifdef cimg_use_openmp
+#include <omp.h>
+#endif
+
+#include <stdio.h>
+#include "graph.h"
+
+
+class EcpException:public std::exception
+{
+public:
+	EcpException(const char* error):m_error(error)
+	{
+	}
+
+	const char *what() const throw()
+	{
+		return m_error.c_str();
+	}
+
+	~EcpException() throw()
+	{
+	}
+
+private:
+	std::string m_error;
+};
+
+
+
+/*!
+\brief create a gaussian mask
+\param _sigma	sigma for distribution
+\param _radius	radius of mask (final size is (2_radius+1)x(2_radius+1))
+\return the gaussian mask
+*/
+CImg<float> GaussianMask(float _sigma, int _radius)
+{
+	//	creates an empty image that will contains the Gaussian mask
+	CImg<float> mask(2*_radius+1, 2*_radius+1);
+
+	//	computes the value of sigma² only once
+	float sigm2= 2*_sigma*_sigma;
+	float fCte = 1.0f/(sigm2*M_PI);
+
+	//	initializes the mask
+	for(int i=0 ; i<mask.dimx() ; i++)
+	{
+		//Compute the value of x², that will remain
+		//constant during the entire loop on y
+		int x2 = i-_radius;
+		x2 = x2*x2;
+		for(int j=0 ; j<mask.dimy() ; j++)
+		{
+			int y = j-_radius;
+			//	the normalization term of the Gaussian is not used, because it will
+			//	disappear with mask normalization (it is a constant)
+			mask(i, j) = fCte*exp(-(x2+y*y)/sigm2);
+		}
+	}
+
+	return mask;
+}
+
+
+/*!
+* \brief Create a sinusoildal mask 
+*/
+
+void SinusoidalMasks(float freq, float dir, 
+										 CImg<float> &cos_mask, CImg<float> &sin_mask)
+{
+	float u0 = freq*cos(dir);
+	float v0 = freq*sin(dir);
+
+	int dx = cos_mask.dimx();
+	int dy = cos_mask.dimy();
+	for(int x = 0; x < dx; x++)
+	{
+		for(int y = 0; y < dy; y++)
+		{
+			cos_mask(x, y) = cos(2.0*M_PI*(u0*(x - dx/2.0) + v0*(dy/2.0 - y)));
+			sin_mask(x, y) = sin(2.0*M_PI*(u0*(x - dx/2.0) + v0*(dy/2.0 - y)));
+		}
+	}
+}
+
+void WriteImage(const CImg <float> & img, const char* fn)
+{
+	//const CImgStats stats(img);
+	float mn = img.min();
+	float mx = img.max(); 
+	//float mn = stats.min;
+	//float mx = stats.max;
+	CImg<unsigned char> to_disk(img.dimx(), img.dimy());
+	//Perform value quantization to the interval [0-256) because when
+	//the image is written to the disk each pixel must be one byte,
+	//i.e. a number in that interval.
+	for(int i = 0; i < img.dimx(); i++)
+	{
+		for(int j = 0; j < img.dimy(); j++)
+		{
+			to_disk(i,j) = static_cast<unsigned char>(255*(img(i,j) - mn)/(mx - mn));
+		}
+	}
+
+	//Write the image to the disk
+	std::cout << "Writing file: " << fn << std::endl;
+	to_disk.save(fn);
+}
+
+
+CImg<float> GaborFilter(float sigma, float freq, float dir, CImg<float> img)
+{
+	CImg<float> g_mask = GaussianMask(sigma, 5*sigma);
+	CImg<float> c_mask(g_mask.dimx(), g_mask.dimy());
+	CImg<float> s_mask(g_mask.dimx(), g_mask.dimy());
+
+	SinusoidalMasks(freq, dir, c_mask, s_mask);
+
+	CImg<float> gf_cos = g_mask.get_mul(c_mask);
+	CImg<float> gf_sin = g_mask.get_mul(s_mask);
+	CImg<float> out_c = img.get_convolve(gf_cos);
+	CImg<float> out_s = img.get_convolve(gf_sin);
+	CImg<float> out = out_c.get_pow(2.0) + out_s.get_pow(2.0);
+	return out.get_sqrt();
+}
+
+typedef Graph<float,float,float> GraphType;
+
+/*!
+ * \brief Build the graph of the binary graph cut segmentation
+ *
+ * The pixels are linked to their 8 neighbours with the weight beta.
+ * Pixel (x,y) is the node y*dimX+x, the order of the CImg buffers, and the
+ * arcs of each edge are consecutive (see Graph::get_first_arc()).
+ * The graph is built in a single pass over the image, with the exact
+ * number of nodes and edges reserved beforehand.
+ * \param capSource  weight of the source edge of each pixel
+ * \param capSink    weight of the sink edge of each pixel
+ * \param beta       weight of the n-links
+ * \param g          a graph to reuse (it is reset), or NULL to allocate a new one
+ * \return the graph, to be deleted by the caller
+ */
+GraphType* BuildGraph(const CImg<float>& capSource, const CImg<float>& capSink, float beta,
+					  GraphType *g = NULL)
+{
+	int dimX = capSource.dimx();
+	int dimY = capSource.dimy();
+
+	// refer to the files "graph.h" ans README.txt for details and explanations
+	// about the Graph class
+
+	// number of edges: horizontal, vertical and the two diagonals
+	int numEdges = (dimX-1)*dimY + dimX*(dimY-1) + 2*(dimX-1)*(dimY-1);
+	if (g)
+	{
+		g -> reset();
+		g -> reserve( dimX*dimY, numEdges );
+	}
+	else
+		g = new GraphType( dimX*dimY, numEdges );
+
+	// there are as many nodes as pixels in the image, they are all added at once
+	g -> add_node( dimX*dimY );
+
+	// t-links and n-links of each pixel: the n-links go to the neighbours
+	// which come after the pixel, so that each edge is added once
+	const float *src = capSource.data;
+	const float *snk = capSink.data;
+	int i = 0;
+	for (int y=0;y<dimY;y++) 
+	{
+		for (int x=0;x<dimX;x++,i++)
+		{
+			g -> add_tweights( i, src[i], snk[i] );
+			if (x<(dimX-1))
+				g -> add_edge( i, i+1, beta, beta ); // (x+1,y)
+			if (y<(dimY-1))
+			{
+				g -> add_edge( i, i+dimX, beta, beta ); // (x,y+1)
+				if (x<(dimX-1))
+					g -> add_edge( i, i+dimX+1, beta, beta ); // (x+1,y+1)
+				if (x>0)
+					g -> add_edge( i, i+dimX-1, beta, beta ); // (x-1,y+1)
+			}
+		}
+	}
+
+	return g;
+}
+
+/*!
+ * \brief Binary graph cut segmentation with the generic Graph
+ * \param capSource  weight of the source edge of each pixel
+ * \param capSink    weight of the sink edge of each pixel
+ * \param beta       weight of the n-links
+ * \param mask       the segmentation, 1 for the source and 0 for the sink (output)
+ * \param g          a graph to reuse, or NULL to allocate a temporary one
+ * \return the maximum flow
+ */
+float SegmentGraph(const CImg<float>& capSource, const CImg<float>& capSink,
+				   float beta, CImg<float>& mask, GraphType *g = NULL)
+{
+	int dimX = capSource.dimx();
+	int dimY = capSource.dimy();
+
+	bool temporary = (g == NULL);
+	g = BuildGraph(capSource, capSink, beta, g);
+
+	// run the min-cut / max-flow algorithm on the graph
+	float flow = g -> maxflow();
+
+	// get the final labels (result) after optimization
+	// overwrite the mask image
+	int i = 0;
+	for (int y=0;y<dimY;y++) 
+	{
+		for (int x=0;x<dimX;x++,i++)
+		{
+			if (g->what_segment(i) == GraphType::SOURCE)
+				mask(x,y)=1;
+			else
+				mask(x,y)=0;				
+		}
+	}
+
+	// release the graph memory
+	if (temporary)
+		delete g;
+	return flow;
+}
+
+/*!
+ * \brief Add delta to the capacity of both arcs of an edge, in the residual graph
+ *
+ * When the flow on the edge exceeds its new capacity, the residual capacity
+ * of one arc would become negative: a = i->j of residual capacity r < 0 costs
+ * r when i is in the source segment and j in the sink segment, which is
+ * rewritten as r on the sink t-link of i, -r on the sink t-link of j and r
+ * on the reverse arc (whose residual capacity stays positive, since the sum
+ * of both residual capacities is twice the new capacity).
+ * The nodes are marked for maxflow(true) when the change is essential.
+ */
+void AddEdgeCapacity(GraphType *g, GraphType::arc_id a, GraphType::arc_id a_rev, float delta)
+{
+	GraphType::node_id i, j;
+	g->get_arc_ends(a, i, j);
+
+	float r = g->get_rcap(a);
+	float r_rev = g->get_rcap(a_rev);
+	bool essential = false;
+	if (r + delta < 0)
+	{
+		g->add_tweights(i, 0, r + delta);
+		g->add_tweights(j, 0, -(r + delta));
+		g->set_rcap(a, 0);
+		g->set_rcap(a_rev, r + r_rev + 2*delta);
+		essential = true;
+	}
+	else if (r_rev + delta < 0)
+	{
+		g->add_tweights(j, 0, r_rev + delta);
+		g->add_tweights(i, 0, -(r_rev + delta));
+		g->set_rcap(a, r + r_rev + 2*delta);
+		g->set_rcap(a_rev, 0);
+		essential = true;
+	}
+	else
+	{
+		g->set_rcap(a, r + delta);
+		g->set_rcap(a_rev, r_rev + delta);
+	}
+
+	// an arc which becomes saturated or unsaturated changes the search trees
+	if (essential || (r == 0) != (g->get_rcap(a) == 0) || (r_rev == 0) != (g->get_rcap(a_rev) == 0))
+	{
+		g->mark_node(i);
+		g->mark_node(j);
+	}
+}
+
+/*!
+ * \brief Regression check of maxflow(true) on nodes added after a maxflow():
+ * nodes added together by add_node(num) must not look as if they were
+ * already in the changed list (mark_node() would skip them).
+ * \return true if maxflow(true) gives the flow of a graph built from scratch
+ */
+bool CheckReuseTreesAfterAddNode()
+{
+	GraphType g(4, 4), fresh(4, 4);
+	GraphType *graphs[2] = { &g, &fresh };
+	for (int k = 0; k < 2; k++)
+	{
+		graphs[k]->add_node(2);
+		graphs[k]->add_tweights(0, 3, 0);
+		graphs[k]->add_tweights(1, 0, 3);
+		graphs[k]->add_edge(0, 1, 1, 0);
+	}
+	g.maxflow();
+	for (int k = 0; k < 2; k++)
+	{
+		graphs[k]->add_node(2);
+		graphs[k]->add_tweights(2, 4, 0);
+		graphs[k]->add_tweights(3, 0, 4);
+		graphs[k]->add_edge(2, 3, 4, 0);
+	}
+	for (int i = 0; i < 4; i++)
+		g.mark_node(i);
+	return g.maxflow(true) == fresh.maxflow();
+}
+
+/*!
+ * \brief Segmentations for several n-link weights, reusing the search trees
+ *
+ * The graph is built and solved once for the smallest weight. For each of
+ * the next weights, in increasing order, the capacities of the n-links are changed in place in the
+ * residual graph and maxflow() is called with reuse_trees (dynamic graph
+ * cuts of Kohli and Torr): only the nodes touched by the changes are
+ * processed again, and only the pixels which may have changed segment
+ * (changed_list) are read.
+ * \param capSource  weight of the source edge of each pixel
+ * \param capSink    weight of the sink edge of each pixel
+ * \param betas      the weights of the n-links
+ * \param masks      one segmentation per weight (output)
+ * \return the maximum flow for each weight
+ */
+std::vector<float> SweepBeta(const CImg<float>& capSource, const CImg<float>& capSink,
+							 const std::vector<float>& betas, CImgList<float>& masks)
+{
+	int dimX = capSource.dimx();
+	int dimY = capSource.dimy();
+	int numBetas = betas.size();
+	std::vector<float> flows(numBetas);
+	masks.assign(numBetas);
+	if (numBetas == 0)
+		return flows;
+
+	// the weights are processed in increasing order: the residual capacities
+	// then only grow, while a smaller weight has to be reparametrised on every
+	// edge whose flow exceeds it, which marks most of the nodes
+	std::vector< std::pair<float, int> > order;
+	for (int k = 0; k < numBetas; k++)
+		order.push_back(std::make_pair(betas[k], k));
+	std::sort(order.begin(), order.end());
+
+	GraphType *g = BuildGraph(capSource, capSink, order[0].first);
+	Block<GraphType::node_id> *changed_list = new Block<GraphType::node_id>(128);
+
+	CImg<float> mask(dimX, dimY);
+	flows[order[0].second] = g->maxflow();
+	for (int i=0;i<dimX*dimY;i++) 
+	{
+		mask(i%dimX,i/dimX) = (g->what_segment(i) == GraphType::SOURCE) ? 1 : 0;
+	}
+	masks[order[0].second] = mask;
+
+	for (int k = 1; k < numBetas; k++)
+	{
+		// the arcs of an edge are consecutive
+		float delta = order[k].first - order[k-1].first;
+		GraphType::arc_id a = g->get_first_arc();
+		for (int e = 0; e < g->get_arc_num(); e += 2)
+		{
+			GraphType::arc_id a_rev = g->get_next_arc(a);
+			AddEdgeCapacity(g, a, a_rev, delta);
+			a = g->get_next_arc(a_rev);
+		}
+
+		flows[order[k].second] = g->maxflow(true, changed_list);
+
+		// the pixels which are not in changed_list keep their segment
+		GraphType::node_id *ptr;
+		for (ptr = changed_list->ScanFirst(); ptr; ptr = changed_list->ScanNext())
+		{
+			GraphType::node_id i = *ptr;
+			g->remove_from_changed_list(i);
+			mask(i%dimX, i/dimX) = (g->what_segment(i) == GraphType::SOURCE) ? 1 : 0;
+		}
+		changed_list->Reset();
+		masks[order[k].second] = mask;
+	}
+
+	delete changed_list;
+	delete g;
+	return flows;
+}
+
+/*!
+ * \brief Same segmentation as SegmentGraph(), with the grid specialised GridGraph
+ *
+ * The nodes are the pixels in row-major order, so that the capacities
+ * are read in the order of the CImg buffers. The energy, and thus the
+ * minimum cut, are the same as in SegmentGraph().
+ * \param blockSize  0 for the sequential maxflow(), otherwise the size of the
+ *                   blocks of the parallel GridGraph::maxflow_parallel()
+ */
+float SegmentGridGraph(const CImg<float>& capSource, const CImg<float>& capSink,
+					   float beta, CImg<float>& mask, int blockSize = 0)
+{
+	int dimX = capSource.dimx();
+	int dimY = capSource.dimy();
+
+	typedef GridGraph<float,float,float> GraphType;
+	GraphType g(dimX, dimY, 8);
+
+	// each edge is added once, from the pixel with the smallest index
+	for (int y=0;y<dimY;y++)
+	{
+		for (int x=0;x<dimX;x++)
+		{
+			if (x<dimX-1)
+				g.add_edge(x, y, GraphType::RIGHT, beta, beta);
+			if (y<dimY-1)
+			{
+				g.add_edge(x, y, GraphType::DOWN, beta, beta);
+				if (x<dimX-1)
+					g.add_edge(x, y, GraphType::DOWN_RIGHT, beta, beta);
+				if (x>0)
+					g.add_edge(x, y, GraphType::DOWN_LEFT, beta, beta);
+			}
+			g.add_tweights(g.get_node_id(x,y), capSource(x,y), capSink(x,y));
+		}
+	}
+
+	float flow = (blockSize > 0) ? g.maxflow_parallel(blockSize) : g.maxflow();
+	std::cout << "GridGraph memory: " << g.get_memory_size()/1024 << " kB" << std::endl;
+
+	for (int y=0;y<dimY;y++)
+	{
+		for (int x=0;x<dimX;x++)
+		{
+			mask(x,y) = (g.what_segment(g.get_node_id(x,y)) == GraphType::SOURCE) ? 1 : 0;
+		}
+	}
+	return flow;
+}
+
+/*!
+ * \brief Labels of a segmentation given as an image with one colour per class
+ *
+ * The classes are numbered in the order of their colours, so that the labels
+ * of a binary mask are 0 for the black pixels and 1 for the white ones.
+ * \param mask  the segmentation (for instance the k-means segmentation of TP5)
+ * \param K     the number of classes (output)
+ * \return the label of each pixel
+ */
+CImg<int> LabelsFromMask(const CImg<float>& mask, int& K)
+{
+	std::map<std::vector<float>, int> colours;
+	std::vector<float> colour(mask.dimv());
+	cimg_forXY(mask,x,y)
+	{
+		for(int v = 0; v < mask.dimv(); v++)
+			colour[v] = mask(x,y,0,v);
+		colours[colour] = 0;
+	}
+
+	K = 0;
+	for(std::map<std::vector<float>, int>::iterator it = colours.begin(); it != colours.end(); it++)
+		it->second = K++;
+
+	CImg<int> labels(mask.dimx(), mask.dimy());
+	cimg_forXY(mask,x,y)
+	{
+		for(int v = 0; v < mask.dimv(); v++)
+			colour[v] = mask(x,y,0,v);
+		labels(x,y) = colours[colour];
+	}
+	return labels;
+}
+
+int main(int argc, char** argv)
+{
+	//open the image
+	CImg<float> img_raw(argv[1]);
+	//open the initial segmentation mask (the output of the k-means segmentation)
+	CImg<float> mask(argv[2]);
+	//show the initial segmentation mask
+	mask.display();
+
+	///////////////////////////////////////////////////
+	//compute the gabor features (the same as in TP5)//
+	///////////////////////////////////////////////////
+
+	/////////// INPUT PARAMETERS /////////////////
+	// input: get the number of directions considered in the Gabor filter bank
+	int numDirections;
+	std::cout << "Number of directions: ";
+	std::cin >> numDirections;
+
+	// input: get the number of used frequencies
+	int numFreqs;
+	std::cout << "Number of Frequencies: ";
+	std::cin >> numFreqs;
+
+	// sigma is the spatial bandwidth of the gabor filter 
+	// f0 is the initial frequency to be considered
+	float f0,sigma;
+	// input: get the spatial bandwidth of the gabor filter 
+	std::cout << "Starting Sigma: ";
+	std::cin >> sigma;
+	f0 = 3/(10*sigma);
+	// fc is the current frequency initialized to f0
+	float fc = f0;
+
+	// get the dimensions of the image
+	int dimX = img_raw.dimx();
+	int dimY = img_raw.dimy();
+
+	// tables with the responses of the Gabor filters
+	CImg<float> **filtered = new CImg<float>*[numFreqs];
+	if(filtered == 0)
+	{
+		std::cerr << "Cannot allocate memory. Exiting" << std::endl;
+		exit(2);
+	}
+	for(int i = 0; i < numFreqs; i++)
+	{
+		filtered[i] = new CImg<float>[numDirections];
+		if(filtered[i] == 0)
+		{
+			std::cerr << "Cannot allocate memory. Exiting" << std::endl;
+			exit(2);
+		}
+	}
+
+	/////////// GABOR FEATURES /////////////////
+	for(int i=0; i < numFreqs; i++)
+	{
+		std::cout<<"Start computation of frequency "<< i+1<<" over "<< numFreqs <<std::endl;
+		std::cout<<"current sigma "<<sigma<<std::endl;
+		std::cout<<"current frequency "<<fc<<std::endl;
+		// Filtering in the directions for the current frequency fc
+		for(int j = 0; j < numDirections; j++)
+		{
+			float dir = j*M_PI/numDirections;
+			filtered[i][j] = GaborFilter(sigma, fc,  dir, img_raw);
+			filtered[i][j].display();
+		}
+		// jump one octave up
+		sigma *= sqrt(2.0);
+		fc = 3/(10*sigma);
+		std::cout<<"End computation of frequency "<< i+1<<" over "<< numFreqs <<std::endl;
+	}
+
+	////////// STORE THE GABOR FEATURES ////////
+	// the Gabor features over all frequencies and directions are stored in a single
+	// image "allFeatures" with one channel per feature: the feature vector of the 
+	// pixel (x,y) is allFeatures(x,y,0,k) for k = 0..N-1, and each feature is a 
+	// contiguous plane of the image.
+
+	//define N the dimension of the features vectors
+	int N = numFreqs*numDirections;
+	CImg<float> allFeatures(dimX,dimY,1,N);
+
+	for(int i=0; i < numFreqs; i++)
+	{
+		for(int j = 0; j < numDirections; j++)
+		{
+			allFeatures.draw_image(0,0,0,i*numDirections+j,filtered[i][j]);
+		}
+	}
+
+
+	///////////////////////////
+	//Graph cuts segmentation//
+	///////////////////////////
+
+	// input: get the edge weight
+	float beta;
+	std::cout << "Edge weight beta: ";
+	std::cin >> beta;
+
+	// the objects 1 and 2 are initially defined using the mask image loaded at the 
+	// beginning of the program: the white pixels of the mask are the object 1.
+
+	///////////////////// COMPUTE THE STATISTICS OF OBJECTS 1 and 2 ////////////////
+	// the means and covariances of the features of each object are computed, and
+	// the covariances are factored once per all (see likelihood.h): their 
+	// determinants and inverses are never computed explicitly
+	GaussianLikelihood object1(allFeatures, mask, true);
+	GaussianLikelihood object2(allFeatures, mask, false);
+	if(object1.GetSampleNum() == 0 || object2.GetSampleNum() == 0)
+	{
+		std::cerr << "The mask must contain both objects. Exiting" << std::endl;
+		exit(1);
+	}
+	if(!object1.IsValid() || !object2.IsValid())
+	{
+		std::cerr << "The features are not finite (NaN or infinite values). Exiting" << std::endl;
+		exit(1);
+	}
+	if(object1.GetJitter() > 0 || object2.GetJitter() > 0)
+	{
+		std::cout << "Singular covariance, regularised with " << object1.GetJitter()
+			<< " (object 1) and " << object2.GetJitter() << " (object 2)" << std::endl;
+	}
+
+
+	// t-links: terminal links/edges
+	// each node is linked to the source (object 1) and the sink (object 2) 
+	// capsource is the weight of the node-source edge, i.e. the cost of cutting it
+	// capsink is the weight of the node-sink edge, i.e. the cost of cutting it
+	// a pixel left in the source segment cuts its sink edge, so capsink is the
+	// negative log-likelihood of the object 1 (up to a constant), and conversely
+
+	CImg<float> capSink = object1.NegLogLikelihood(allFeatures);
+	CImg<float> capSource = object2.NegLogLikelihood(allFeatures);
+
+
+	///////////////////// GRAPH CONSTRUCTION & OPTIMIZATION ////////////////
+
+	// input: choose the max-flow implementation
+	int solver;
+	std::cout << "Max-flow solver (0: Graph, 1: GridGraph, 2: parallel GridGraph, 3: beta sweep, "
+		<< "4: multi-label expansion, 5: multi-label swap): ";
+	std::cin >> solver;
+
+	if(solver == 4 || solver == 5)
+	{
+		// the classes are the colours of the initial segmentation, each one
+		// with its own Gaussian distribution of the features
+		int K;
+		CImg<int> labels = LabelsFromMask(mask, K);
+		CImg<float> dataCost(dimX,dimY,1,K);
+		for(int k = 0; k < K; k++)
+		{
+			GaussianLikelihood object(allFeatures, labels, k);
+			if(!object.IsValid())
+			{
+				std::cerr << "The features are not finite (NaN or infinite values). Exiting" << std::endl;
+				exit(1);
+			}
+			dataCost.draw_image(0,0,0,k,object.NegLogLikelihood(allFeatures));
+		}
+
+		PottsSegmentation potts(dataCost, beta);
+		std::cout << K << " classes, initial energy " << potts.Energy(labels) << std::endl;
+		unsigned long start = cimg::time();
+		int cycles = (solver == 4) ? potts.Expansion(labels) : potts.Swap(labels);
+		std::cout << "Energy " << potts.Energy(labels) << " after " << cycles << " cycles, computed in "
+			<< cimg::time() - start << " ms" << std::endl;
+
+		mask.assign(labels);
+	}
+	else if(solver == 3)
+	{
+		// input: get the other edge weights, beta is the first one
+		int numBetas;
+		std::cout << "Number of other edge weights: ";
+		std::cin >> numBetas;
+		std::vector<float> betas(1, beta);
+		for(int k = 0; k < numBetas; k++)
+		{
+			float b;
+			std::cout << "Edge weight " << k+1 << ": ";
+			std::cin >> b;
+			betas.push_back(b);
+		}
+
+		if (!CheckReuseTreesAfterAddNode())
+			std::cerr << "Warning: maxflow(true) differs from maxflow() after add_node()" << std::endl;
+
+		unsigned long start = cimg::time();
+		CImgList<float> masks;
+		std::vector<float> flows = SweepBeta(capSource, capSink, betas, masks);
+		std::cout << "Sweep computed in " << cimg::time() - start << " ms" << std::endl;
+
+		// the same segmentations computed independently, in the same graph
+		start = cimg::time();
+		GraphType g(dimX*dimY, 0);
+		for(unsigned int k = 0; k < betas.size(); k++)
+		{
+			float flow = SegmentGraph(capSource, capSink, betas[k], mask, &g);
+			std::cout << "beta " << betas[k] << ": flow " << flows[k] << " (" << flow << ")"
+				<< ((mask == masks[k]) ? "" : ", different segmentation") << std::endl;
+		}
+		std::cout << "Independent segmentations computed in " << cimg::time() - start << " ms" << std::endl;
+
+		for(unsigned int k = 0; k < masks.size; k++)
+		{
+			std::ostringstream fn;
+			fn << "finalMask_" << k << ".png";
+			WriteImage(masks[k], fn.str().c_str());
+		}
+		mask = masks[masks.size - 1];
+	}
+	else if(solver == 2)
+	{
+		// input: get the size of the blocks discharged in parallel
+		int blockSize;
+		std::cout << "Block size: ";
+		std::cin >> blockSize;
+
+		// the same cut is computed with 1, 2, 4... threads
+		int maxThreads = 1;
+#ifdef cimg_use_openmp
+		maxThreads = omp_get_max_threads();
+#endif
+		for(int numThreads = 1; ; numThreads *= 2)
+		{
+			if(numThreads > maxThreads)
+				numThreads = maxThreads;
+#ifdef cimg_use_openmp
+			omp_set_num_threads(numThreads);
+#endif
+			unsigned long start = cimg::time();
+			float flow = SegmentGridGraph(capSource, capSink, beta, mask, blockSize);
+			std::cout << numThreads << " threads: flow " << flow << " computed in "
+				<< cimg::time() - start << " ms" << std::endl;
+			if(numThreads == maxThreads)
+				break;
+		}
+	}
+	else
+	{
+		unsigned long start = cimg::time();
+		float flow;
+		if(solver == 0)
+			flow = SegmentGraph(capSource, capSink, beta, mask);
+		else
+			flow = SegmentGridGraph(capSource, capSink, beta, mask);
+		std::cout << "Flow " << flow << " computed in " << cimg::time() - start << " ms" << std::endl;
+	}
+
+	mask.display();
+
+	//write result to disk
+	WriteImage(mask,"finalMask.png");
+
+	// release allocated memory
+	for(int i = 0; i < numFreqs; i++)
+	{
+		delete[] filtered[i];
+	}
+	delete[]filtered;
+	return 0;
+}
+
+
+///////////////////////////////////////////////////
\ No newline at end of file
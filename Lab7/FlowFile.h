@@ -0,0 +1,394 @@
+/***************************************************************************
+ *   Copyright (C) 2007 by                                                 *
+ *                                                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+#ifndef FLOWFILE_H
+#define FLOWFILE_H
+
+/*
+  Optical flow files.
+
+  A .flo file (Middlebury format) contains one flow, in little endian:
+    "PIEH" (the float 202021.25), width and height (32 bits integers),
+    then width*height pairs (u,v) of floats, row by row.
+
+  A flow sequence file contains the flows of a sequence:
+    "FLOS", the number of flows (32 bits integer), the offset of the index
+    (64 bits integer), then the flows, each one being a complete .flo record,
+    then the index: the offset of each flow (64 bits integers).
+  A flow of the sequence can then be read as a .flo file starting at its
+  offset. FlowSequenceWriter writes the flows one after the other, and
+  FlowSequenceReader maps the file in memory: opening a file and accessing
+  a flow do not read the other flows.
+
+  The flows are in the layout of computeOpticalFlow: a dimX x dimY x 2
+  image, u in the slice 0 and v in the slice 1.
+  The files are read and written on little endian machines only.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <vector>
+#include "EcpException.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// size of the header of a .flo record
+#define FLO_HEADER_SIZE 12
+// size of the header of a flow sequence file
+#define FLOS_HEADER_SIZE 16
+
+/**
+ * Write a flow as a .flo record at the current position of a file.
+ * @param file the file, opened in binary mode
+ * @param flow the flow (2 slices)
+ * @return the number of bytes written
+ */
+inline long long writeFloRecord( FILE* file, const CImg<float>& flow )
+{
+    if( flow.dimz() < 2 )
+        throw EcpException( "writeFloRecord: invalid optical flow argument" );
+    int dimX = flow.dimx();
+    int dimY = flow.dimy();
+    const float *u = flow.data, *v = flow.data + dimX*dimY;
+
+    bool ok = fwrite( "PIEH", 1, 4, file ) == 4 && fwrite( &dimX, 4, 1, file ) == 1 && fwrite( &dimY, 4, 1, file ) == 1;
+
+    // interleave u and v row by row
+    std::vector<float> row( 2*dimX );
+    for( int y = 0; ok && y < dimY; y++ )
+    {
+        for( int x = 0; x < dimX; x++ )
+        {
+            row[2*x] = u[y*dimX + x];
+            row[2*x+1] = v[y*dimX + x];
+        }
+        ok = fwrite( &row[0], sizeof(float), 2*dimX, file ) == (size_t)( 2*dimX );
+    }
+    if( !ok )
+        throw EcpException( "writeFloRecord: write error" );
+    return FLO_HEADER_SIZE + 8LL*dimX*dimY;
+}
+
+/**
+ * Convert interleaved (u,v) pairs, as in a .flo record, to a flow.
+ * @param data dimX*dimY pairs (u,v), row by row
+ * @param dimX size of the flow
+ * @param dimY 
+ * @param flow result, dimX x dimY x 2
+ */
+inline void deinterleaveFlow( const float* data, int dimX, int dimY, CImg<float>& flow )
+{
+    flow.assign( dimX, dimY, 2 );
+    long long pixelN = (long long)dimX*dimY;
+    float *u = flow.data, *v = flow.data + pixelN;
+    for( long long i = 0; i < pixelN; i++ )
+    {
+        u[i] = data[2*i];
+        v[i] = data[2*i+1];
+    }
+}
+
+/**
+ * Write a flow in a .flo file (Middlebury format).
+ * @param fileName the file
+ * @param flow the flow (2 slices)
+ */
+inline void writeFlo( const char* fileName, const CImg<float>& flow )
+{
+    FILE *file = fopen( fileName, "wb" );
+    if( !file )
+        throw EcpException( "writeFlo: cannot create the file" );
+    try
+    {
+        writeFloRecord( file, flow );
+    }
+    catch( EcpException& )
+    {
+        fclose( file );
+        throw;
+    }
+    fclose( file );
+}
+
+/**
+ * Streaming writer of a flow sequence file: each flow is written when it
+ is appended, and the index is written by close() (or the destructor).
+ */
+class FlowSequenceWriter
+{
+public:
+    /**
+     * Create the file.
+     * @param fileName the file
+     */
+    FlowSequenceWriter( const char* fileName )
+        : _offset( FLOS_HEADER_SIZE )
+    {
+        _file = fopen( fileName, "wb" );
+        if( !_file )
+            throw EcpException( "FlowSequenceWriter: cannot create the file" );
+        // the header is written again by close()
+        char header[FLOS_HEADER_SIZE] = { 'F', 'L', 'O', 'S' };
+        if( fwrite( header, 1, FLOS_HEADER_SIZE, _file ) != FLOS_HEADER_SIZE )
+        {
+            fclose( _file );
+            throw EcpException( "FlowSequenceWriter: write error" );
+        }
+    }
+
+    ~FlowSequenceWriter()
+    {
+        if( _file )
+        {
+            try { close(); } catch( EcpException& ) {}
+        }
+    }
+
+    /**
+     * Write the next flow of the sequence.
+     * @param flow the flow (2 slices)
+     */
+    void append( const CImg<float>& flow )
+    {
+        if( !_file )
+            throw EcpException( "FlowSequenceWriter: the file is closed" );
+        long long size;
+        try
+        {
+            size = writeFloRecord( _file, flow );
+        }
+        catch( EcpException& )
+        {
+            // drop the partial record, the next one starts at _offset
+            fseek( _file, (long)_offset, SEEK_SET );
+            throw;
+        }
+        _index.push_back( _offset );
+        _offset += size;
+    }
+
+    /**
+     * Write the index and the header, and close the file.
+     */
+    void close()
+    {
+        if( !_file )
+            return;
+        int flowN = _index.size();
+        bool ok = _index.empty() || fwrite( &_index[0], 8, flowN, _file ) == (size_t)flowN;
+        ok = ok && fseek( _file, 4, SEEK_SET ) == 0
+                && fwrite( &flowN, 4, 1, _file ) == 1
+                && fwrite( &_offset, 8, 1, _file ) == 1;
+        ok = fclose( _file ) == 0 && ok;
+        _file = NULL;
+        if( !ok )
+            throw EcpException( "FlowSequenceWriter: write error" );
+    }
+
+private:
+    // not copyable
+    FlowSequenceWriter( const FlowSequenceWriter& );
+    FlowSequenceWriter& operator=( const FlowSequenceWriter& );
+
+    FILE *_file;
+    long long _offset;              // offset of the next flow
+    std::vector<long long> _index;  // offsets of the flows
+};
+
+/**
+ * Reader of a flow sequence file or of a .flo file (a sequence of one
+ flow). The file is mapped in memory: data() gives the (u,v) pairs of a
+ flow in the file without any copy, get() copies a flow in the layout of
+ computeOpticalFlow.
+ */
+class FlowSequenceReader
+{
+public:
+    /**
+     * Map the file and check its index.
+     * @param fileName a flow sequence file or a .flo file
+     */
+    FlowSequenceReader( const char* fileName )
+        : _base( NULL ), _size( 0 )
+    {
+#ifdef _WIN32
+        _file = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        if( _file == INVALID_HANDLE_VALUE )
+            throw EcpException( "FlowSequenceReader: cannot open the file" );
+        LARGE_INTEGER size;
+        GetFileSizeEx( _file, &size );
+        _size = size.QuadPart;
+        _mapping = _size ? CreateFileMappingA( _file, NULL, PAGE_READONLY, 0, 0, NULL ) : NULL;
+        if( _mapping )
+            _base = (const char*)MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+#else
+        _file = open( fileName, O_RDONLY );
+        if( _file < 0 )
+            throw EcpException( "FlowSequenceReader: cannot open the file" );
+        struct stat status;
+        if( fstat( _file, &status ) == 0 )
+            _size = status.st_size;
+        if( _size )
+        {
+            void *base = mmap( NULL, _size, PROT_READ, MAP_SHARED, _file, 0 );
+            _base = base == MAP_FAILED ? NULL : (const char*)base;
+        }
+#endif
+        if( !_base )
+        {
+            unmap();
+            throw EcpException( "FlowSequenceReader: cannot map the file" );
+        }
+
+        bool ok = _size >= FLO_HEADER_SIZE;
+        if( ok && !memcmp( _base, "PIEH", 4 ) )
+            _index.push_back( 0 );
+        else if( ok && !memcmp( _base, "FLOS", 4 ) && _size >= FLOS_HEADER_SIZE )
+        {
+            int flowN;
+            long long indexOffset;
+            memcpy( &flowN, _base + 4, 4 );
+            memcpy( &indexOffset, _base + 8, 8 );
+            // divisions rather than products, which could overflow
+            ok = flowN >= 0 && indexOffset >= FLOS_HEADER_SIZE && indexOffset <= _size
+                 && flowN <= ( _size - indexOffset )/8;
+            if( ok )
+            {
+                _index.resize( flowN );
+                if( flowN )
+                    memcpy( &_index[0], _base + indexOffset, 8*flowN );
+            }
+        }
+        else
+            ok = false;
+
+        // check every record: the pairs must be in the file, and a flow
+        // (2 slices) must fit in an image of at most INT_MAX values
+        for( int i = 0; ok && i < (int)_index.size(); i++ )
+        {
+            ok = _index[i] >= 0 && _index[i] <= _size - FLO_HEADER_SIZE && !memcmp( _base + _index[i], "PIEH", 4 )
+                 && width( i ) >= 0 && height( i ) >= 0;
+            if( ok )
+            {
+                long long pixelN = (long long)width( i )*height( i );
+                ok = pixelN <= INT_MAX/2 && pixelN <= ( _size - _index[i] - FLO_HEADER_SIZE )/8;
+            }
+        }
+        if( !ok )
+        {
+            unmap();
+            throw EcpException( "FlowSequenceReader: invalid flow file" );
+        }
+    }
+
+    ~FlowSequenceReader()
+    {
+        unmap();
+    }
+
+    // number of flows in the file
+    int size() const { return _index.size(); }
+
+    // size of the flow i
+    int width( int i ) const { int w; memcpy( &w, _base + _index[i] + 4, 4 ); return w; }
+    int height( int i ) const { int h; memcpy( &h, _base + _index[i] + 8, 4 ); return h; }
+
+    /**
+     * The flow i in the mapped file, without copy.
+     * @param i index of the flow
+     * @return width(i)*height(i) pairs (u,v), row by row
+     */
+    const float* data( int i ) const
+    {
+        if( i < 0 || i >= size() )
+            throw EcpException( "FlowSequenceReader: invalid flow index" );
+        return (const float*)( _base + _index[i] + FLO_HEADER_SIZE );
+    }
+
+    /**
+     * Copy the flow i in the layout of computeOpticalFlow.
+     * @param i index of the flow
+     * @param flow result, width(i) x height(i) x 2
+     */
+    void get( int i, CImg<float>& flow ) const
+    {
+        deinterleaveFlow( data( i ), width( i ), height( i ), flow );
+    }
+
+private:
+    void unmap()
+    {
+#ifdef _WIN32
+        if( _base )
+            UnmapViewOfFile( _base );
+        if( _mapping )
+            CloseHandle( _mapping );
+        if( _file != INVALID_HANDLE_VALUE )
+            CloseHandle( _file );
+        _mapping = NULL;
+        _file = INVALID_HANDLE_VALUE;
+#else
+        if( _base )
+            munmap( (void*)_base, _size );
+        if( _file >= 0 )
+            ::close( _file );
+        _file = -1;
+#endif
+        _base = NULL;
+    }
+
+    // not copyable
+    FlowSequenceReader( const FlowSequenceReader& );
+    FlowSequenceReader& operator=( const FlowSequenceReader& );
+
+#ifdef _WIN32
+    HANDLE _file, _mapping;
+#else
+    int _file;
+#endif
+    const char *_base;              // the mapped file
+    long long _size;                // size of the file
+    std::vector<long long> _index;  // offsets of the flows
+};
+
+/**
+ * Write the flows of a sequence in a flow sequence file.
+ * @param fileName the file
+ * @param optFlow the flows, e.g. computed by computeOpticalFlow
+ */
+inline void saveOptFlow( const char* fileName, const CImgList<float>& optFlow )
+{
+    FlowSequenceWriter writer( fileName );
+    for( unsigned int i = 0; i < optFlow.size; i++ )
+        writer.append( optFlow[i] );
+    writer.close();
+}
+
+/**
+ * Read all the flows of a flow sequence file (or of a .flo file).
+ * @param fileName the file
+ * @param optFlow the flows
+ */
+inline void loadOptFlow( const char* fileName, CImgList<float>& optFlow )
+{
+    FlowSequenceReader reader( fileName );
+    optFlow.assign( reader.size() );
+    for( int i = 0; i < reader.size(); i++ )
+        reader.get( i, optFlow[i] );
+}
+
+#endif
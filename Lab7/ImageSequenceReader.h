@@ -0,0 +1,302 @@
+/***************************************************************************
+ *   Copyright (C) 2007 by                                                 *
+ *                                                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+#ifndef IMAGESEQUENCEREADER_H
+#define IMAGESEQUENCEREADER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "EcpException.h"
+
+/**
+ * Mean of three channels, n pixels. The channels are restrict parameters
+ and the loop has a single stream per channel, so that it vectorizes.
+ */
+inline void greyFromRGB( const float *__restrict r, const float *__restrict g, const float *__restrict b,
+                         float *__restrict grey, int n )
+{
+#ifdef cimg_use_openmp
+#pragma omp simd
+#endif
+    for( int i = 0; i < n; i++ )
+        grey[i] = ( r[i] + g[i] + b[i] )/3.0f;
+}
+
+/**
+ * Grey levels of a row of n BGR triples (24 bits BMP), mean of the three
+ bytes. The stride is fixed, so that the loop vectorizes when the target
+ can shuffle bytes into floats (e.g. -march=x86-64-v3 with GCC, plain SSE2
+ keeps it scalar).
+ */
+inline void greyFromBGRRow( const unsigned char *__restrict bgr, float *__restrict grey, int n )
+{
+#ifdef cimg_use_openmp
+#pragma omp simd
+#endif
+    for( int x = 0; x < n; x++ )
+        grey[x] = ( bgr[3*x] + bgr[3*x+1] + bgr[3*x+2] )/3.0f;
+}
+
+/**
+ * Grey-level image of a color image, mean of the channels: one pass over the
+ pixels, without the temporary images of get_channels. Three channels
+ images go through greyFromRGB, the other ones add the channels one after
+ the other to the result. The sum is divided by the number of channels, as
+ in the BMP path of loadGreyImage, so that both give the same values.
+ * @param image any number of channels
+ * @param grey result, one channel
+ */
+inline void greyFromColor( const CImg<float>& image, CImg<float>& grey )
+{
+    int channelN = image.dimv();
+    int pixelN = image.dimx()*image.dimy()*image.dimz();
+    grey.assign( image.dimx(), image.dimy(), image.dimz(), 1 );
+    const float *in = image.data;
+    if( channelN == 3 )
+    {
+        greyFromRGB( in, in + pixelN, in + 2*pixelN, grey.data, pixelN );
+        return;
+    }
+
+    const float channels = (float)channelN;
+    float *out = grey.data;
+    for( int i = 0; i < pixelN; i++ )
+        out[i] = in[i];
+    for( int c = 1; c < channelN; c++ )
+    {
+        const float *channel = in + c*pixelN;
+        for( int i = 0; i < pixelN; i++ )
+            out[i] += channel[i];
+    }
+    for( int i = 0; i < pixelN; i++ )
+        out[i] /= channels;
+}
+
+/**
+ * Load an image as grey-level values (mean of the channels). Uncompressed
+ 8 and 24 bits BMP files are decoded directly into the grey-level image,
+ row by row, without the color image. The other files are loaded by CImg
+ then converted with greyFromColor.
+ * @param fileName the file
+ * @param grey result, one channel
+ */
+inline void loadGreyImage( const char* fileName, CImg<float>& grey )
+{
+    FILE *file = fopen( fileName, "rb" );
+    unsigned char header[54];
+    if( file && fread( header, 1, 54, file ) == 54 && header[0] == 'B' && header[1] == 'M' )
+    {
+#define BMP_U16( p ) ( (unsigned int)(p)[0] | ( (unsigned int)(p)[1] << 8 ) )
+#define BMP_U32( p ) ( BMP_U16( p ) | ( BMP_U16( (p)+2 ) << 16 ) )
+        unsigned int offset = BMP_U32( header + 10 );
+        unsigned int dibSize = BMP_U32( header + 14 );
+        int width = (int)BMP_U32( header + 18 );
+        int height = (int)BMP_U32( header + 22 );
+        unsigned int bpp = BMP_U16( header + 28 );
+        unsigned int compression = BMP_U32( header + 30 );
+        unsigned int colorN = BMP_U32( header + 46 );
+        bool topDown = height < 0;
+        if( topDown )
+            height = -height;
+
+        if( compression == 0 && ( bpp == 8 || bpp == 24 ) && width > 0 && height > 0 )
+        {
+            // grey level of each color of the palette
+            float lut[256];
+            bool ok = true;
+            if( bpp == 8 )
+            {
+                if( colorN == 0 || colorN > 256 )
+                    colorN = 256;
+                unsigned char palette[4*256];
+                ok = fseek( file, 14 + dibSize, SEEK_SET ) == 0 && fread( palette, 4, colorN, file ) == colorN;
+                for( unsigned int c = 0; c < 256; c++ )
+                    lut[c] = c < colorN ? ( palette[4*c] + palette[4*c+1] + palette[4*c+2] )/3.0f : 0;
+            }
+
+            int rowSize = ( ( width*bpp + 31 )/32 )*4;
+            std::vector<unsigned char> row( rowSize );
+            grey.assign( width, height );
+            ok = ok && fseek( file, offset, SEEK_SET ) == 0;
+            for( int r = 0; ok && r < height; r++ )
+            {
+                ok = fread( &row[0], 1, rowSize, file ) == (size_t)rowSize;
+                float *out = grey.data + ( topDown ? r : height-1-r )*width;
+                const unsigned char *p = &row[0];
+                if( bpp == 8 )
+                    for( int x = 0; x < width; x++ )
+                        out[x] = lut[p[x]];
+                else
+                    greyFromBGRRow( p, out, width );
+            }
+            fclose( file );
+            if( !ok )
+                throw CImgIOException( "loadGreyImage() : File '%s' is truncated.", fileName );
+            return;
+        }
+#undef BMP_U16
+#undef BMP_U32
+    }
+    if( file )
+        fclose( file );
+
+    CImg<float> image( fileName );
+    if( image.dimv() == 1 )
+        grey.swap( image );
+    else
+        greyFromColor( image, grey );
+}
+
+/**
+ * Streaming reader of a sequence of images, with the same file names as
+ loadImages. A background thread decodes the frames into a buffer of at
+ most bufferSize frames, and next() returns them in order: the frames are
+ processed while the next ones are being decoded, and a sequence of any
+ length is read in constant memory. With grey = true the frames are
+ decoded directly as grey-level values (see loadGreyImage).
+ * Usage:
+ *     ImageSequenceReader reader( "../taxi/", "taxi", 1, 41, 1, "bmp" );
+ *     CImg<float> frame;
+ *     while( reader.next( frame ) )
+ *         ...
+ */
+class ImageSequenceReader
+{
+public:
+    /**
+     * Start decoding the sequence in the background.
+     * @param path complete path with trailing / e.g: "/home/user/images/"
+     * @param prefix prefix of the file names
+     * @param indexMin the files are indexed between indexMin and indexMax (included)
+     * @param indexMax 
+     * @param indexStep 
+     * @param extension type of the files (without "."). e.g: "png", "jpg", "jpeg"...
+     * @param bufferSize maximum number of decoded frames waiting for next()
+     * @param grey if true the frames are grey-level values (mean of the channels)
+     */
+    ImageSequenceReader( const char* path, const char* prefix,
+                         int indexMin, int indexMax, int indexStep,
+                         const char* extension, int bufferSize = 4, bool grey = false )
+        : _path( path ), _prefix( prefix ), _extension( extension ),
+          _indexMin( indexMin ), _indexMax( indexMax ), _indexStep( indexStep ),
+          _bufferSize( bufferSize < 1 ? 1 : bufferSize ), _grey( grey ),
+          _finished( false ), _stop( false )
+    {
+        _error[0] = '\0';
+        _thread = std::thread( &ImageSequenceReader::decode, this );
+    }
+
+    /**
+     * Stop the decoding thread, the frames which were not read are lost.
+     */
+    ~ImageSequenceReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _stop = true;
+        }
+        _notFull.notify_all();
+        _thread.join();
+    }
+
+    /**
+     * Wait for the next frame of the sequence.
+     * @param image the frame, its buffer is exchanged with the one of the
+     decoded frame (no copy)
+     * @return false at the end of the sequence
+     */
+    bool next( CImg<float>& image )
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        while( _buffer.empty() && !_finished )
+            _notEmpty.wait( lock );
+        if( _buffer.empty() )
+        {
+            if( _error[0] )
+                throw EcpException( _error );
+            return false;
+        }
+        image.swap( _buffer.front() );
+        _buffer.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+private:
+    // decoding thread
+    void decode()
+    {
+        char fileName[1000];
+        for( int index = _indexMin; index <= _indexMax; index += _indexStep )
+        {
+            sprintf( fileName, "%s%s%d.%s", _path.c_str(), _prefix.c_str(), index, _extension.c_str() );
+
+            // Decode without the lock, then wait for a free place in the buffer
+            CImg<float> frame;
+            try
+            {
+                if( _grey )
+                    loadGreyImage( fileName, frame );
+                else
+                    frame.load( fileName );
+            }
+            catch( CImgException& )
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                sprintf( _error, "ImageSequenceReader: cannot read %.150s", fileName );
+                break;
+            }
+            catch( ... )
+            {
+                // e.g. out of memory: an exception must not leave the thread
+                std::lock_guard<std::mutex> lock( _mutex );
+                sprintf( _error, "ImageSequenceReader: cannot decode %.150s", fileName );
+                break;
+            }
+
+            std::unique_lock<std::mutex> lock( _mutex );
+            while( !_stop && (int)_buffer.size() >= _bufferSize )
+                _notFull.wait( lock );
+            if( _stop )
+                return;
+            _buffer.push_back( CImg<float>() );
+            _buffer.back().swap( frame );
+            _notEmpty.notify_one();
+        }
+
+        std::lock_guard<std::mutex> lock( _mutex );
+        _finished = true;
+        _notEmpty.notify_one();
+    }
+
+    // not copyable
+    ImageSequenceReader( const ImageSequenceReader& );
+    ImageSequenceReader& operator=( const ImageSequenceReader& );
+
+    std::string _path, _prefix, _extension;
+    int _indexMin, _indexMax, _indexStep;
+    int _bufferSize;
+    bool _grey;
+
+    std::deque< CImg<float> > _buffer;  // decoded frames, in order
+    bool _finished;                     // all the frames were decoded (or an error occurred)
+    bool _stop;                         // the reader is destroyed
+    char _error[200];
+    std::mutex _mutex;
+    std::condition_variable _notEmpty, _notFull;
+    std::thread _thread;
+};
+
+#endif
@@ -0,0 +1,414 @@
+/***************************************************************************
+ *   Copyright (C) 2007 by                                                 *
+ *                                                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+// Accuracy and speed of the optical flow methods of libECP.h, without any
+// window. A sequence is synthesised for each known field F by warping an
+// image with the bilinear sampling of warpImage: frame k+1 at q is frame k
+// at q-F(q). The pixel p of frame k thus moves to the q such that
+// q = p+F(q), and the true (forward) flow at p is F(q), which is F(p) only
+// for the translation (see forwardFlow).
+// Each method of computeOpticalFlow is run on each sequence, and the
+// results are written on the standard output as JSON:
+//   epe             mean end-point error, in pixels
+//   angular_error   mean angular error of the vectors (u,v,1), in degrees
+//   scored_fraction fraction of the pixels of the pairs where they are computed
+//   ms_per_frame    wall time of computeOpticalFlow per pair of frames
+//   peak_rss_kb     peak resident memory of the process so far
+// The errors are only computed where the frames do not depend on the
+// clamped border: the chain of samples which gives a pixel from the first
+// frame must stay in the image, for every pixel within BORDER_MARGIN pixels
+// (the windows of the methods), in both frames of the pair.
+// The messages of libECP.h go to the error output.
+
+// Usual libraries
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// CImg library
+#define cimg_display 0
+#include "CImg.h"
+using namespace cimg_library;
+
+// Stl
+#include <vector>
+using namespace std;
+ 
+// Custom libraries
+#include "libECP.h"
+
+#define BORDER_MARGIN 16
+
+/**
+ * Peak resident memory of the process, in kilobytes.
+ */
+long peakResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) )
+        return -1;
+    return (long)( counters.PeakWorkingSetSize/1024 );
+#else
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+        return -1;
+#ifdef __APPLE__
+    return usage.ru_maxrss/1024;// bytes on Mac OS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/**
+ * Textured test image, when no image is given: sinusoids of several
+ periods and a smoothed pseudo-random noise (the same on every run).
+ * @param dimX 
+ * @param dimY 
+ */
+CImg<float> syntheticImage( int dimX, int dimY )
+{
+    CImg<float> noise( dimX, dimY );
+    unsigned int seed = 12345;
+    cimg_forXY( noise, x, y )
+    {
+        seed = seed*1103515245 + 12345;
+        noise( x, y ) = (float)( ( seed >> 16 ) & 0x7fff )/0x7fff;
+    }
+    CImg<float> image;
+    GaussianBlurSeparable( image, noise, 1.5f );
+    image *= 255;
+    cimg_forXY( image, x, y )
+        image( x, y ) += 40*sin( x*0.09f )*cos( y*0.07f ) + 30*sin( ( x+2*y )*0.023f );
+    return image;
+}
+
+/**
+ * Known flow fields of the synthetic sequences.
+ */
+enum FlowField
+{
+    FIELD_TRANSLATION,      // constant vector
+    FIELD_ROTATION_ZOOM,    // rotation and zoom around the centre of the image
+    FIELD_SHEAR_WAVE,       // smooth non-rigid motion
+    FIELD_N
+};
+
+const char* flowFieldName( FlowField field )
+{
+    switch( field )
+    {
+        case FIELD_TRANSLATION: return "translation";
+        case FIELD_ROTATION_ZOOM: return "rotation_zoom";
+        default: return "shear_wave";
+    }
+}
+
+/**
+ * Value of a known field at a point.
+ * @param field 
+ * @param x the point
+ * @param y 
+ * @param dimX size of the image
+ * @param dimY 
+ * @param u result
+ * @param v 
+ */
+void fieldAt( FlowField field, float x, float y, int dimX, int dimY, float& u, float& v )
+{
+    if( field == FIELD_TRANSLATION )
+    {
+        u = 2.3f;
+        v = -1.4f;
+    }
+    else if( field == FIELD_ROTATION_ZOOM )
+    {
+        float angle = 0.02f, zoom = 1.02f;
+        float dx = x - ( dimX-1 )/2.0f, dy = y - ( dimY-1 )/2.0f;
+        u = zoom*( cos(angle)*dx - sin(angle)*dy ) - dx;
+        v = zoom*( sin(angle)*dx + cos(angle)*dy ) - dy;
+    }
+    else
+    {
+        u = 1.5f*sin( 2*M_PI*y/dimY );
+        v = cos( 2*M_PI*x/dimX );
+    }
+}
+
+/**
+ * A known field at the pixels (2 slices, u and v): the displacements used
+ to synthesise the frames (see synthesiseSequence).
+ * @param field 
+ * @param dimX 
+ * @param dimY 
+ */
+CImg<float> samplingFlow( FlowField field, int dimX, int dimY )
+{
+    CImg<float> flow( dimX, dimY, 2 );
+    cimg_forXY( flow, x, y )
+        fieldAt( field, x, y, dimX, dimY, flow( x, y, 0 ), flow( x, y, 1 ) );
+    return flow;
+}
+
+/**
+ * True flow of the pairs of a synthetic sequence: the pixel p of frame k
+ is at the q of frame k+1 such that q = p+F(q). q is the fixed point of
+ q <- p+F(q), which converges since the gradients of the fields are much
+ smaller than 1.
+ * @param field 
+ * @param dimX 
+ * @param dimY 
+ */
+CImg<float> forwardFlow( FlowField field, int dimX, int dimY )
+{
+    CImg<float> flow( dimX, dimY, 2 );
+    cimg_forXY( flow, x, y )
+    {
+        float u, v;
+        fieldAt( field, x, y, dimX, dimY, u, v );
+        for( int iteration = 0; iteration < 50; iteration++ )
+        {
+            float nextU, nextV;
+            fieldAt( field, x+u, y+v, dimX, dimY, nextU, nextV );
+            bool converged = fabs( nextU-u ) < 1e-6f && fabs( nextV-v ) < 1e-6f;
+            u = nextU;
+            v = nextV;
+            if( converged )
+                break;
+        }
+        flow( x, y, 0 ) = u;
+        flow( x, y, 1 ) = v;
+    }
+    return flow;
+}
+
+/**
+ * Sequence of frames whose consecutive pairs move by the field flow: frame
+ k+1 is frame k sampled at (x-u,y-v), as in warpImage (the border is
+ clamped instead of being black, and the values are not normalized).
+ valid[k] is 1 where frame k does not depend on the clamped border, i.e.
+ where all the bilinear samples from frame 0 are in the image.
+ * @param image first frame
+ * @param flow (see samplingFlow)
+ * @param frameN number of frames
+ * @param frames result
+ * @param valid result
+ */
+void synthesiseSequence( const CImg<float>& image, const CImg<float>& flow, int frameN,
+                         CImgList<float>& frames, CImgList<float>& valid )
+{
+    int dimX = image.dimx();
+    int dimY = image.dimy();
+    frames.assign( frameN, dimX, dimY );
+    valid.assign( frameN, dimX, dimY );
+    frames[0] = image;
+    valid[0].fill( 1 );
+    for( int k = 1; k < frameN; k++ )
+    {
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+        for( int y = 0; y < dimY; y++ )
+        {
+            const float *u = flow.data + y*dimX, *v = flow.data + (dimY+y)*dimX;
+            sampleBilinearRow( frames[k-1], 0, y, u, v, -1, frames[k].data + y*dimX, dimX, BORDER_CLAMP );
+            // the samples of a valid pixel only read valid pixels: they
+            // are in the image and their bilinear mean of valid[k-1] is 1
+            std::vector<unsigned char> inside( dimX );
+            float *row = valid[k].data + y*dimX;
+            sampleBilinearRow( valid[k-1], 0, y, u, v, -1, row, dimX, BORDER_ZERO, &inside[0] );
+            for( int x = 0; x < dimX; x++ )
+                row[x] = inside[x] && row[x] > 0.9999f ? 1.0f : 0.0f;
+        }
+    }
+}
+
+/**
+ * Keep the pixels whose window of radius BORDER_MARGIN is valid and in the
+ image.
+ * @param valid 0/1 mask, eroded in place
+ */
+void erodeValidMask( CImg<float>& valid )
+{
+    int dimX = valid.dimx();
+    int dimY = valid.dimy();
+    // the mean of the window is 1 iff all its pixels are 1
+    int windowN = ( 2*BORDER_MARGIN+1 )*( 2*BORDER_MARGIN+1 );
+    BoxFilter( valid, BORDER_MARGIN );
+    cimg_forXY( valid, x, y )
+    {
+        bool inImage = x >= BORDER_MARGIN && y >= BORDER_MARGIN && x < dimX-BORDER_MARGIN && y < dimY-BORDER_MARGIN;
+        valid( x, y ) = inImage && valid( x, y ) > 1 - 0.5f/windowN ? 1.0f : 0.0f;
+    }
+}
+
+/**
+ * Mean end-point error and mean angular error (in degrees) of the flows of
+ a sequence, where the pixel is valid in the first frame of the pair and
+ its destination is valid in the second one.
+ * @param optFlow computed flows
+ * @param truth true flow of every pair (see forwardFlow)
+ * @param valid the valid pixels of each frame, eroded (see erodeValidMask)
+ * @param epe result
+ * @param angularError result
+ * @param scoredFraction result, fraction of the pixels of the pairs which are scored
+ */
+void flowErrors( const CImgList<float>& optFlow, const CImg<float>& truth, const CImgList<float>& valid,
+                 double& epe, double& angularError, double& scoredFraction )
+{
+    int dimX = truth.dimx();
+    int dimY = truth.dimy();
+    int pixelN = dimX*dimY;
+    double epeSum = 0, angleSum = 0;
+    long sampleN = 0;
+    for( int i = 0; i < (int)optFlow.size; i++ )
+    {
+        const float *u = optFlow[i].data, *v = u + pixelN;
+        const float *tu = truth.data, *tv = tu + pixelN;
+        for( int y = 0; y < dimY; y++ )
+        {
+            for( int x = 0; x < dimX; x++ )
+            {
+                int p = y*dimX + x;
+                int qx = (int)floor( x + tu[p] + 0.5f ), qy = (int)floor( y + tv[p] + 0.5f );
+                if( !valid[i]( x, y ) || qx < 0 || qy < 0 || qx >= dimX || qy >= dimY || !valid[i+1]( qx, qy ) )
+                    continue;
+                double du = u[p]-tu[p], dv = v[p]-tv[p];
+                epeSum += sqrt( du*du + dv*dv );
+                double c = ( u[p]*tu[p] + v[p]*tv[p] + 1 )
+                           /sqrt( ( u[p]*u[p] + v[p]*v[p] + 1 )*( tu[p]*tu[p] + tv[p]*tv[p] + 1 ) );
+                c = c > 1 ? 1 : ( c < -1 ? -1 : c );
+                angleSum += acos( c );
+                sampleN++;
+            }
+        }
+    }
+    epe = sampleN ? epeSum/sampleN : 0;
+    angularError = sampleN ? angleSum/sampleN*180/M_PI : 0;
+    scoredFraction = optFlow.size ? (double)sampleN/( (double)pixelN*optFlow.size ) : 0;
+}
+
+/**
+ * Print a string as a JSON string literal (quotes, backslashes and control
+ characters escaped).
+ */
+void printJsonString( const char* text )
+{
+    putchar( '"' );
+    for( const unsigned char *c = (const unsigned char*)text; *c; c++ )
+    {
+        if( *c == '"' || *c == '\\' )
+            printf( "\\%c", *c );
+        else if( *c < 0x20 )
+            printf( "\\u%04x", *c );
+        else
+            putchar( *c );
+    }
+    putchar( '"' );
+}
+
+int main(int argc, char *argv[])
+{
+    if( argc > 3 )
+    {
+        cerr << "Usage: " << argv[0] << " [image] [frames]" << endl << endl
+             << "  image:  the first frame of the synthetic sequences (a textured image"
+             << endl
+             << "          is generated if it is omitted or \"-\")"
+             << endl
+             << "  frames: number of frames of each sequence (default 6)"
+             << endl;
+        exit(1);
+    }
+    const char *imageName = argc > 1 && strcmp( argv[1], "-" ) ? argv[1] : NULL;
+    int frameN = argc > 2 ? atoi( argv[2] ) : 6;
+    if( frameN < 2 )
+        frameN = 2;
+
+    // the messages of libECP.h must not go into the JSON
+    streambuf *outBuffer = cout.rdbuf( cerr.rdbuf() );
+
+    try
+    {
+        CImg<float> image;
+        if( imageName )
+            loadGreyImage( imageName, image );
+        else
+            image = syntheticImage( 320, 240 );
+        if( image.dimx() <= 2*BORDER_MARGIN || image.dimy() <= 2*BORDER_MARGIN )
+            throw EcpException( "main: the image is too small" );
+
+        FlowMethod methods[2] = { FLOW_LUCAS_KANADE, FLOW_HORN_SCHUNCK };
+        const char *methodNames[2] = { "lucas_kanade", "horn_schunck" };
+
+        printf( "{\n" );
+        printf( "  \"image\": " );
+        printJsonString( imageName ? imageName : "synthetic" );
+        printf( ",\n" );
+        printf( "  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n", image.dimx(), image.dimy(), frameN );
+#ifdef cimg_use_openmp
+        printf( "  \"threads\": %d,\n", omp_get_max_threads() );
+#else
+        printf( "  \"threads\": 1,\n" );
+#endif
+        printf( "  \"results\": [" );
+
+        CImgList<float> frames, valid, optFlow;
+        for( int f = 0; f < FIELD_N; f++ )
+        {
+            CImg<float> field = samplingFlow( (FlowField)f, image.dimx(), image.dimy() );
+            CImg<float> truth = forwardFlow( (FlowField)f, image.dimx(), image.dimy() );
+            synthesiseSequence( image, field, frameN, frames, valid );
+            for( int k = 0; k < frameN; k++ )
+                erodeValidMask( valid[k] );
+            for( int m = 0; m < 2; m++ )
+            {
+                optFlow.assign();
+                double t = cimg::time();
+                computeOpticalFlow( frames, optFlow, 4, 3, 4, methods[m] );
+                double msPerFrame = ( cimg::time() - t )/( frameN-1 );
+
+                double epe, angularError, scoredFraction;
+                flowErrors( optFlow, truth, valid, epe, angularError, scoredFraction );
+                printf( "%s\n    {\"sequence\": \"%s\", \"method\": \"%s\", \"epe\": %.4f, "
+                        "\"angular_error\": %.4f, \"scored_fraction\": %.3f, \"ms_per_frame\": %.2f, \"peak_rss_kb\": %ld}",
+                        f+m ? "," : "", flowFieldName( (FlowField)f ), methodNames[m],
+                        epe, angularError, scoredFraction, msPerFrame, peakResidentMemory() );
+                fflush( stdout );
+            }
+        }
+        printf( "\n  ]\n}\n" );
+    }
+    catch( EcpException& )
+    {
+        // the message was written by the exception
+        cout.rdbuf( outBuffer );
+        return 1;
+    }
+    catch( CImgException& e )
+    {
+        cout.rdbuf( outBuffer );
+        cerr << "ERROR: " << e.message << endl;
+        return 1;
+    }
+
+    cout.rdbuf( outBuffer );
+    return 0;
+}
@@ -69,7 +69,10 @@ int main(int argc, char *argv[])
     cout << imageN << " images were loaded." << endl;
     CImgList<float> images;
     for( int i = 0; i < imageN; i++ )
-        images.push_back( (imagesColor[i].get_channels(0,0) + imagesColor[i].get_channels(1,1) + imagesColor[i].get_channels(2,2))/3 );
+    {
+        images.push_back( CImg<float>() );
+        greyFromColor( imagesColor[i], images.back() );
+    }
 
     if ( imageN == 2)
         displayAndCompare2Images(images[0],images[1]);
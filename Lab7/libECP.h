@@ -13,8 +13,11 @@
 #define LIBECP_INCLUDED
 
 #include "EcpException.h"
+#include "ImageSequenceReader.h"
+#include "FlowFile.h"
 #define _USE_MATH_DEFINES	//	defines the value for pi
 #include <math.h>
+#include <vector>
 
 #ifdef min
 #undef min
@@ -37,21 +40,23 @@ float	GetInterpolatedValue(const CImg<float> &image,float x, float y, int z );
  * @param indexMax 
  * @param indexStep 
  * @param extension type of the files (without "."). e.g: "png", "jpg", "jpeg"...
+ * @param grey if true the images are loaded as grey-level values (see loadGreyImage)
  */
 void loadImages( CImgList<float>& images, char* path, char* prefix, 
 		 int indexMin, int indexMax, int indexStep, 
-   		 char* extension )
+   		 char* extension, bool grey = false )
 {
     char fileName[1000];
     for( int index = indexMin; index <= indexMax; index += indexStep )
     {
         sprintf( fileName, "%s%s%d.%s", path, prefix, index, extension );
 		
-        // Create and load image
-        CImg<float> newImg( fileName );
-		
-        // Put image in list
-        images.push_back( newImg );
+        // Put an empty image in the list and load the file in place
+        images.push_back( CImg<float>() );
+        if( grey )
+            loadGreyImage( fileName, images.back() );
+        else
+            images.back().load( fileName );
     }
 }
 
@@ -99,10 +104,119 @@ void displayImageSequence( CImgList<float>& images, int delay = -1, bool loop =
     }
 }
 
+/**
+ * Gaussian window used to smooth the optical flow before drawing the arrows
+ (10x10, sigma = 2, normalized).
+ */
+CImg<float> flowArrowGaussian()
+{
+    int dimGaussianX = 10;
+    int dimGaussianY = 10;
+    float sigma = 2;
+    float colorGaussian = 1;
+    CImg<float> gaussian( dimGaussianX, dimGaussianY );
+    gaussian.draw_gaussian( (dimGaussianX-1.0)/2.0, (dimGaussianY-1.0)/2.0, 
+                            sigma, &colorGaussian );
+    gaussian /= gaussian.sum();
+    return gaussian;
+}
+
+/**
+ * Optical flow at one pixel, smoothed by a window: the same value as the
+ pixel (x,y) of optFlow.get_slice(z).correlate( gaussian ), but only the
+ pixels of the window are read.
+ * @param optFlow the flow (2 slices)
+ * @param gaussian the window (see flowArrowGaussian)
+ * @param x the pixel
+ * @param y 
+ * @param u result
+ * @param v 
+ */
+void smoothedFlowAt( const CImg<float>& optFlow, const CImg<float>& gaussian, int x, int y, float& u, float& v )
+{
+    int dimX = optFlow.dimx();
+    int dimY = optFlow.dimy();
+    // offsets of the window, as in CImg::correlate()
+    int mx1 = gaussian.dimx()/2 - 1 + gaussian.dimx()%2;
+    int my1 = gaussian.dimy()/2 - 1 + gaussian.dimy()%2;
+    const float *flowU = optFlow.data, *flowV = optFlow.data + dimX*dimY;
+    u = v = 0;
+    for( int j = 0; j < gaussian.dimy(); j++ )
+    {
+        int yj = y + j - my1;
+        yj = yj < 0 ? 0 : ( yj >= dimY ? dimY-1 : yj );
+        for( int i = 0; i < gaussian.dimx(); i++ )
+        {
+            int xi = x + i - mx1;
+            xi = xi < 0 ? 0 : ( xi >= dimX ? dimX-1 : xi );
+            float w = gaussian( i, j );
+            u += w*flowU[yj*dimX + xi];
+            v += w*flowV[yj*dimX + xi];
+        }
+    }
+}
+
+/**
+ * Color coding of an optical flow: the hue is the direction of the vector
+ and the saturation its norm (white for a null vector).
+ * @param optFlow the flow (2 slices)
+ * @param maxNorm norm of the fully saturated vectors, the largest norm of
+ the flow if maxNorm <= 0
+ * @return a 3-channels image in [0,255]
+ */
+CImg<float> flowToColor( const CImg<float>& optFlow, float maxNorm = 0 )
+{
+    int dimX = optFlow.dimx();
+    int dimY = optFlow.dimy();
+    int pixelN = dimX*dimY;
+    const float *u = optFlow.data, *v = optFlow.data + pixelN;
+    if( maxNorm <= 0 )
+    {
+        for( int i = 0; i < pixelN; i++ )
+        {
+            float norm = sqrt( u[i]*u[i] + v[i]*v[i] );
+            maxNorm = norm > maxNorm ? norm : maxNorm;
+        }
+        if( maxNorm <= 0 )
+            maxNorm = 1;
+    }
+
+    CImg<float> color( dimX, dimY, 1, 3 );
+    float *r = color.data, *g = r + pixelN, *b = g + pixelN;
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int i = 0; i < pixelN; i++ )
+    {
+        float saturation = sqrt( u[i]*u[i] + v[i]*v[i] )/maxNorm;
+        saturation = saturation > 1 ? 1 : saturation;
+        // hue in [0,6[, 0 for a vector along +x
+        float hue = (float)( 3*( atan2( -v[i], -u[i] )/M_PI + 1 ) );
+        hue = hue >= 6 ? 0 : hue;
+        int sector = (int)hue;
+        float f = hue - sector;
+        float rgb[3];
+        switch( sector )
+        {
+            case 0: rgb[0] = 1; rgb[1] = f; rgb[2] = 0; break;
+            case 1: rgb[0] = 1-f; rgb[1] = 1; rgb[2] = 0; break;
+            case 2: rgb[0] = 0; rgb[1] = 1; rgb[2] = f; break;
+            case 3: rgb[0] = 0; rgb[1] = 1-f; rgb[2] = 1; break;
+            case 4: rgb[0] = f; rgb[1] = 0; rgb[2] = 1; break;
+            default: rgb[0] = 1; rgb[1] = 0; rgb[2] = 1-f; break;
+        }
+        r[i] = 255*( 1 - saturation*( 1 - rgb[0] ) );
+        g[i] = 255*( 1 - saturation*( 1 - rgb[1] ) );
+        b[i] = 255*( 1 - saturation*( 1 - rgb[2] ) );
+    }
+    return color;
+}
+
 /**
  * Visualize an images described by an optical flow field. 
  Arguments must have the same x and y dimensions. 
- Results are blurred by a 10x10 gaussian window in order to have a smoother field.
+ Results are blurred by a 10x10 gaussian window in order to have a smoother field
+ (only at the pixels where the arrows are drawn, see smoothedFlowAt).
  * @param image 
  * @param optFlow 
  * @param disp result is returned in disp
@@ -116,33 +230,21 @@ void visualizeOpticalFlow( const CImg<float>& image, const CImg<float>& optFlow,
     int dimX = image.dimx();
     int dimY = image.dimy();
 	
-    // Blur the optical flow results
-    // with a gaussian window
-    int dimGaussianX = 10;
-    int dimGaussianY = 10;
-    float sigma = 2;
-    float colorGaussian = 1;
-    CImg<float> gaussian( dimGaussianX, dimGaussianY );
-    gaussian.draw_gaussian( (dimGaussianX-1.0)/2.0, (dimGaussianY-1.0)/2.0, 
-                            sigma, &colorGaussian );
-    gaussian /= gaussian.sum();
-    CImg<float> blurredSlice0, blurredSlice1;
-    blurredSlice0 = optFlow.get_slice(0);
-    blurredSlice0.correlate( gaussian );
-    blurredSlice1 = optFlow.get_slice(1);
-    blurredSlice1.correlate( gaussian );
+    // Gaussian window of the optical flow
+    CImg<float> gaussian = flowArrowGaussian();
 
     // Define the color of the arrows
     float red[3] = {255, 0, 0};
-    float white[3] = {255, 255, 255};
 
     // Draw the arrows
     for( int x = 1; x < dimX-1; x += 10 )
     {
         for( int y = 1; y < dimY-1; y += 10 )
         {
-            int x1 = x + (int)( sc*blurredSlice0( x, y ) );
-            int y1 = y + (int)( sc*blurredSlice1( x, y ) );
+            float u, v;
+            smoothedFlowAt( optFlow, gaussian, x, y, u, v );
+            int x1 = x + (int)( sc*u );
+            int y1 = y + (int)( sc*v );
 
             disp.draw_arrow( x, y, x1, y1, red, 45, -25 );
         }
@@ -155,11 +257,14 @@ void visualizeOpticalFlow( const CImg<float>& image, const CImg<float>& optFlow,
  * @param optFlow 
  * @param delay same as in displayImageSequence function
  * @param loop same as in displayImageSequence function
+ * @param colorWheel if true the flows are displayed with flowToColor
+ (with the same scale for the whole sequence) instead of arrows
  */
 void visualizeOpticalFlow( const CImgList<float>& images, 
 			   const CImgList<float>& optFlow,
       			   int delay = -1,
-     			   bool loop = false )
+     			   bool loop = false,
+     			   bool colorWheel = false )
 {
     cout << "----------> Visualize the optical flow" << endl;
     // Check arguments
@@ -179,69 +284,959 @@ void visualizeOpticalFlow( const CImgList<float>& images,
             throw EcpException( "visualizeOpticalFlow: only color images are accepted as input" );
     }
 	
-    // Blur the optical flow results
-    // with a gaussian window
-    cout << "-----> Smoothing the sequence..." << endl;
-    int dimGaussianX = 10;
-    int dimGaussianY = 10;
-    float sigma = 2;
-    float colorGaussian = 1;
-    CImg<float> gaussian( dimGaussianX, dimGaussianY );
-    gaussian.draw_gaussian( (dimGaussianX-1.0)/2.0, (dimGaussianY-1.0)/2.0, 
-                            sigma, &colorGaussian );
-    gaussian /= gaussian.sum();
-    CImgList<float> optFlowBlurred( optFlow );
-    CImg<float> blurredSlice0, blurredSlice1;
-    // Actually this for loop can be commented out to accelerate computation
-    for( int i = 0; i < nbOpticalFlow; i++ )
-    {
-        blurredSlice0 = optFlow[i].get_slice(0);
-        blurredSlice0.correlate( gaussian );
-        blurredSlice1 = optFlow[i].get_slice(1);
-        blurredSlice1.correlate( gaussian );
-        for( int x = 0; x < optFlow[i].dimx(); x++ )
+    // Here we go
+    CImgList<float> disp( images );
+    if( colorWheel )
+    {
+        float maxNorm = 0;
+        for( int i = 0; i < nbOpticalFlow; i++ )
         {
-            for( int y = 0; y < optFlow[i].dimy(); y++ )
+            const CImg<float>& flow = optFlow[i];
+            int pixelN = flow.dimx()*flow.dimy();
+            for( int p = 0; p < pixelN; p++ )
             {
-                optFlowBlurred[i]( x, y, 0 ) = blurredSlice0(x,y);
-                optFlowBlurred[i]( x, y, 1 ) = blurredSlice1(x,y);
+                float norm = sqrt( flow.data[p]*flow.data[p] + flow.data[pixelN+p]*flow.data[pixelN+p] );
+                maxNorm = norm > maxNorm ? norm : maxNorm;
             }
         }
+        for( int i = 0; i < nbOpticalFlow; i++ )
+            disp[i] = flowToColor( optFlow[i], maxNorm );
+    }
+    else
+    {
+        for( int i = 0; i < nbOpticalFlow; i++ )
+            visualizeOpticalFlow( images[i], optFlow[i], disp[i] );
     }
-    cout << "-----> done." << endl;
-	
-    // Define the color of the arrows
-    float red[3] = {255, 0, 0};
-    float white[3] = {255, 255, 255};
 	
-    // Here we go
-    CImgList<float> disp( images );
-    for( int i = 0; i < nbOpticalFlow; i++ )
+    displayImageSequence( disp, delay, loop );
+}
+
+/**
+ * Blur an image with a separable gaussian filter.
+ Borders are handled by replicating the first and last rows and columns,
+ so that a constant image stays constant.
+ * @param _out output image, resized to the size of _in
+ * @param _in input image (one slice, one channel)
+ * @param _sigma sigma of the gaussian, the radius of the filter is 3*sigma
+ */
+void GaussianBlurSeparable( CImg<float>& _out, const CImg<float>& _in, float _sigma )
+{
+    int dimX = _in.dimx();
+    int dimY = _in.dimy();
+    int radius = (int)( 3*_sigma );
+    if( radius < 1 )
+        radius = 1;
+
+    // Normalized 1D kernel
+    CImg<float> kernel( 2*radius+1 );
+    float sum = 0;
+    for( int j = -radius; j <= radius; j++ )
+        sum += kernel[j+radius] = exp( -j*j/(2*_sigma*_sigma) );
+    kernel /= sum;
+    const float *k = kernel.data + radius;
+
+    CImg<float> tmp( dimX, dimY );
+    _out.assign( dimX, dimY );
+
+    // Horizontal pass, the border tests are only done near the borders
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int y = 0; y < dimY; y++ )
     {
-        int dimX = disp[i].dimx();
-        int dimY = disp[i].dimy();
-        for( int x = 1; x < dimX-1; x += 10 )
+        const float *in = _in.data + y*dimX;
+        float *t = tmp.data + y*dimX;
+        for( int x = 0; x < dimX; x++ )
         {
-            for( int y = 1; y < dimY-1; y += 10 )
+            float s = 0;
+            if( x >= radius && x < dimX-radius )
             {
-                int x1 = x + (int)( sc*optFlowBlurred[i]( x, y, 0 ) );
-                int y1 = y + (int)( sc*optFlowBlurred[i]( x, y, 1 ) );
-				
-                disp[i].draw_arrow( x, y, x1, y1, red, 45, -25 );
+                for( int j = -radius; j <= radius; j++ )
+                    s += k[j]*in[x+j];
             }
+            else
+            {
+                for( int j = -radius; j <= radius; j++ )
+                {
+                    int xj = x+j < 0 ? 0 : ( x+j >= dimX ? dimX-1 : x+j );
+                    s += k[j]*in[xj];
+                }
+            }
+            t[x] = s;
         }
     }
-	
-    displayImageSequence( disp, delay, loop );
+
+    // Vertical pass, on whole rows
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int y = 0; y < dimY; y++ )
+    {
+        float *out = _out.data + y*dimX;
+        for( int x = 0; x < dimX; x++ )
+            out[x] = 0;
+        for( int j = -radius; j <= radius; j++ )
+        {
+            int yj = y+j < 0 ? 0 : ( y+j >= dimY ? dimY-1 : y+j );
+            const float *t = tmp.data + yj*dimX;
+            const float kj = k[j];
+            for( int x = 0; x < dimX; x++ )
+                out[x] += kj*t[x];
+        }
+    }
+}
+
+/**
+ * Build a gaussian pyramid: each level is the previous one blurred
+ (sigma = 1) and subsampled by 2. The pixel (x,y) of a level is the
+ pixel (2x,2y) of the previous one.
+ * @param image grey-level image, level 0 of the pyramid
+ * @param pyramid the levels, from the finest to the coarsest. The images
+ already in the list are reused when they have the right size, so that
+ the same list can be filled with the pyramids of a whole sequence.
+ * @param levelN maximum number of levels. Levels smaller than 16 pixels are not built.
+ */
+void buildPyramid( const CImg<float>& image, CImgList<float>& pyramid, int levelN )
+{
+    int dimX = image.dimx();
+    int dimY = image.dimy();
+    int n = 1;
+    while( n < levelN && dimX >= 32 && dimY >= 32 )
+    {
+        dimX = ( dimX+1 )/2;
+        dimY = ( dimY+1 )/2;
+        n++;
+    }
+    if( (int)pyramid.size != n )
+        pyramid.assign( n );
+
+    pyramid[0] = image;
+    CImg<float> blurred;
+    for( int level = 1; level < n; level++ )
+    {
+        const CImg<float>& fine = pyramid[level-1];
+        GaussianBlurSeparable( blurred, fine, 1 );
+        dimX = ( fine.dimx()+1 )/2;
+        dimY = ( fine.dimy()+1 )/2;
+        CImg<float>& coarse = pyramid[level];
+        coarse.assign( dimX, dimY );
+        for( int y = 0; y < dimY; y++ )
+        {
+            const float *in = blurred.data + 2*y*blurred.dimx();
+            float *out = coarse.data + y*dimX;
+            for( int x = 0; x < dimX; x++ )
+                out[x] = in[2*x];
+        }
+    }
+}
+
+/**
+ * Resample an optical flow with a separable bilinear filter: the pixel
+ (x,y) of the result is the flow at (x/factor,y/factor), and the vectors
+ are multiplied by factor. With factor = 2 this is the upsampling from a
+ level of a pyramid to the next finer one (see buildPyramid). The pixels
+ beyond the last row and column of the input are replicated.
+ The rows are first interpolated along x, then the pairs of rows along y,
+ the two components of the flow in the same loops.
+ * @param _in flow to resample (2 slices)
+ * @param dimX size of the result
+ * @param dimY 
+ * @param factor ratio between the sizes of the result and of the input
+ * @return the resampled flow
+ */
+CImg<float> upsampleOptFlow( const CImg<float>& _in, int dimX, int dimY, float factor = 2 )
+{
+    int inX = _in.dimx();
+    int inY = _in.dimy();
+    const float *inU = _in.data, *inV = _in.data + inX*inY;
+
+    // Neighbours and weights along x, the same for every row
+    CImg<int> x0s( dimX ), x1s( dimX );
+    CImg<float> wx( dimX );
+    for( int x = 0; x < dimX; x++ )
+    {
+        float xs = x/factor;
+        int x0 = (int)xs;
+        x0s[x] = x0 < inX-1 ? x0 : inX-1;
+        x1s[x] = x0 < inX-1 ? x0+1 : inX-1;
+        wx[x] = x0 < inX-1 ? xs - x0 : 0;
+    }
+
+    // Horizontal pass on the rows of the input
+    CImg<float> tmp( dimX, inY, 2 );
+    float *tmpU = tmp.data, *tmpV = tmp.data + dimX*inY;
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int y = 0; y < inY; y++ )
+    {
+        const float *ru = inU + y*inX, *rv = inV + y*inX;
+        float *tu = tmpU + y*dimX, *tv = tmpV + y*dimX;
+        for( int x = 0; x < dimX; x++ )
+        {
+            int x0 = x0s[x], x1 = x1s[x];
+            tu[x] = ru[x0] + wx[x]*( ru[x1] - ru[x0] );
+            tv[x] = rv[x0] + wx[x]*( rv[x1] - rv[x0] );
+        }
+    }
+
+    // Vertical pass, on whole rows
+    CImg<float> _out( dimX, dimY, 2 );
+    float *outU = _out.data, *outV = _out.data + dimX*dimY;
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int y = 0; y < dimY; y++ )
+    {
+        float ys = y/factor;
+        int y0 = (int)ys;
+        int y1 = y0 < inY-1 ? y0+1 : inY-1;
+        float wy = y0 < inY-1 ? ys - y0 : 0;
+        y0 = y0 < inY-1 ? y0 : inY-1;
+        const float *u0 = tmpU + y0*dimX, *u1 = tmpU + y1*dimX;
+        const float *v0 = tmpV + y0*dimX, *v1 = tmpV + y1*dimX;
+        float *ou = outU + y*dimX, *ov = outV + y*dimX;
+        for( int x = 0; x < dimX; x++ )
+        {
+            ou[x] = factor*( u0[x] + wy*( u1[x] - u0[x] ) );
+            ov[x] = factor*( v0[x] + wy*( v1[x] - v0[x] ) );
+        }
+    }
+    return _out;
 }
 
 /**
- * This is the function you will have to complete in 
- order to compute the optical flow in a sequence of images.
+ * Border handling of the bilinear sampler (sampleBilinearRow).
+ */
+enum BorderMode
+{
+    BORDER_ZERO,    // the pixels outside of the image are 0, as in GetInterpolatedValue
+    BORDER_CLAMP    // the pixels outside of the image are the nearest pixels of the border
+};
+
+/**
+ * Bilinear interpolation near the border of an image (see sampleBilinearRow).
+ * @param plane the pixels of a slice of the image
+ * @param dimX size of the image
+ * @param dimY 
+ * @param x0 top left neighbour of the sample
+ * @param y0 
+ * @param fx position of the sample relative to (x0,y0), in [0,1[
+ * @param fy 
+ * @param border border mode
+ */
+inline float sampleBilinearBorder( const float *plane, int dimX, int dimY, int x0, int y0,
+                                   float fx, float fy, BorderMode border )
+{
+    float value = 0;
+    for( int j = 0; j < 2; j++ )
+    {
+        int yj = y0+j;
+        float wy = j ? fy : 1-fy;
+        if( yj < 0 || yj >= dimY )
+        {
+            if( border == BORDER_ZERO )
+                continue;
+            yj = yj < 0 ? 0 : dimY-1;
+        }
+        for( int i = 0; i < 2; i++ )
+        {
+            int xi = x0+i;
+            float wx = i ? fx : 1-fx;
+            if( xi < 0 || xi >= dimX )
+            {
+                if( border == BORDER_ZERO )
+                    continue;
+                xi = xi < 0 ? 0 : dimX-1;
+            }
+            value += wx*wy*plane[yj*dimX + xi];
+        }
+    }
+    return value;
+}
+
+/**
+ * Bilinear sampling of an image along a row of displacements:
+ out[x] is the value of the image at (x + scale*du[x], y + scale*dv[x]),
+ for x in [0,n). The samples whose four neighbours are in the image
+ (nearly all of them) are computed without any bounds check, the other
+ ones according to the border mode.
+ * @param image input image
+ * @param z slice of the image
+ * @param y row of the samples
+ * @param du displacements along x (n values)
+ * @param dv displacements along y (n values)
+ * @param scale factor of the displacements, e.g. -1 to sample at (x-u,y-v)
+ * @param out result (n values)
+ * @param n number of samples
+ * @param border border mode
+ * @param inside if not NULL, inside[x] is set to 1 when the sample is in
+ [0,dimX-1]x[0,dimY-1] and to 0 otherwise
+ */
+void sampleBilinearRow( const CImg<float>& image, int z, int y, const float *du, const float *dv, float scale,
+                        float *out, int n, BorderMode border = BORDER_ZERO, unsigned char *inside = NULL )
+{
+    int dimX = image.dimx();
+    int dimY = image.dimy();
+    const float *plane = image.data + z*dimX*dimY;
+    for( int x = 0; x < n; x++ )
+    {
+        float xs = x + scale*du[x];
+        float ys = y + scale*dv[x];
+        if( inside )
+            inside[x] = xs >= 0 && ys >= 0 && xs <= dimX-1 && ys <= dimY-1;
+        // (int) rounds towards 0, -1 gives the floor of the negative values
+        int x0 = (int)xs - ( xs < 0 );
+        int y0 = (int)ys - ( ys < 0 );
+        float fx = xs - x0;
+        float fy = ys - y0;
+        if( x0 >= 0 && y0 >= 0 && x0 < dimX-1 && y0 < dimY-1 )
+        {
+            const float *p = plane + y0*dimX + x0;
+            out[x] = (1-fy)*( (1-fx)*p[0] + fx*p[1] ) + fy*( (1-fx)*p[dimX] + fx*p[dimX+1] );
+        }
+        else
+            out[x] = sampleBilinearBorder( plane, dimX, dimY, x0, y0, fx, fy, border );
+    }
+}
+
+/**
+ * Replace each pixel by the mean of a (2*radius+1)x(2*radius+1) window,
+ with running sums: the cost per pixel does not depend on the radius.
+ Borders are handled by replicating the first and last rows and columns.
+ * @param _img image, filtered in place, channel by channel
+ * @param _radius radius of the window
+ */
+void BoxFilter( CImg<float>& _img, int _radius )
+{
+    int dimX = _img.dimx();
+    int dimY = _img.dimy();
+    int channelN = _img.dimv();
+    float norm = 1.0f/( (2*_radius+1)*(2*_radius+1) );
+
+#ifdef cimg_use_openmp
+#pragma omp parallel
+#endif
+    {
+        CImg<float> line( dimX );
+        CImg<float> sum( dimX );
+
+        // Horizontal pass, row by row
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
+        for( int r = 0; r < channelN*dimY; r++ )
+        {
+            float *row = _img.data + r*dimX;
+            memcpy( line.data, row, dimX*sizeof(float) );
+            float s = ( _radius+1 )*line[0];
+            for( int j = 1; j <= _radius; j++ )
+                s += line[j < dimX ? j : dimX-1];
+            for( int x = 0; x < dimX; x++ )
+            {
+                row[x] = s;
+                int xIn = x+_radius+1 < dimX ? x+_radius+1 : dimX-1;
+                int xOut = x-_radius > 0 ? x-_radius : 0;
+                s += line[xIn] - line[xOut];
+            }
+        }
+
+        // Vertical pass, with a running sum of whole rows
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
+        for( int c = 0; c < channelN; c++ )
+        {
+            float *channel = _img.data + c*dimX*dimY;
+            CImg<float> rows( channel, dimX, dimY );
+            int x;
+            for( x = 0; x < dimX; x++ )
+                sum[x] = ( _radius+1 )*rows.data[x];
+            for( int j = 1; j <= _radius; j++ )
+            {
+                const float *r = rows.data + ( j < dimY ? j : dimY-1 )*dimX;
+                for( x = 0; x < dimX; x++ )
+                    sum[x] += r[x];
+            }
+            for( int y = 0; y < dimY; y++ )
+            {
+                const float *rIn = rows.data + ( y+_radius+1 < dimY ? y+_radius+1 : dimY-1 )*dimX;
+                const float *rOut = rows.data + ( y-_radius > 0 ? y-_radius : 0 )*dimX;
+                float *out = channel + y*dimX;
+                for( x = 0; x < dimX; x++ )
+                {
+                    out[x] = norm*sum[x];
+                    sum[x] += rIn[x] - rOut[x];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Windowed structure tensor of Lucas-Kanade, between image0 and image1
+ warped by the current flow. The products of the derivatives are computed
+ in a single pass over the images and stored in the channels of tensor:
+ 0: Ix2, 1: IxIy, 2: Iy2, 3: IxIt, 4: IyIt,
+ then averaged over a box window (BoxFilter).
+ Ix and Iy are the central differences of image0. It is the difference
+ between the warped image1 and image0, minus Ix*u + Iy*v: every pixel of a
+ window is then linearized around the flow of the center of the window, and
+ the systems give the new flow and not an increment of the flow of each
+ pixel (the increments are not stable when the flow is not constant over
+ the window). The pixels which are warped outside of the image keep
+ their flow.
+ * @param image0 first image
+ * @param image1 second image, same size
+ * @param flow current flow (2 slices), image1(x+u,y+v) is compared to image0(x,y)
+ * @param tensor result, dimX x dimY x 1 x 5
+ * @param radius radius of the window, 0 for the products without window
+ * @param mismatchOnly if true only the channels 3 and 4 are computed, the
+ other ones are kept (they do not depend on the flow)
+ */
+void computeStructureTensor( const CImg<float>& image0, const CImg<float>& image1, const CImg<float>& flow,
+                             CImg<float>& tensor, int radius, bool mismatchOnly = false )
+{
+    int dimX = image0.dimx();
+    int dimY = image0.dimy();
+    int pixelN = dimX*dimY;
+    if( !mismatchOnly || tensor.dimx() != dimX || tensor.dimy() != dimY || tensor.dimv() != 5 )
+    {
+        tensor.assign( dimX, dimY, 1, 5 );
+        mismatchOnly = false;
+    }
+    float *Ix2 = tensor.data, *IxIy = Ix2 + pixelN, *Iy2 = IxIy + pixelN;
+    float *IxIt = Iy2 + pixelN, *IyIt = IxIt + pixelN;
+    const float *u = flow.data, *v = flow.data + pixelN;
+
+#ifdef cimg_use_openmp
+#pragma omp parallel
+#endif
+    {
+        // the row of image1 warped by the flow
+        CImg<float> warped( dimX );
+        CImg<unsigned char> inside( dimX );
+
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
+        for( int y = 0; y < dimY; y++ )
+        {
+            const float *r = image0.data + y*dimX;
+            const float *rUp = image0.data + ( y > 0 ? y-1 : y )*dimX;
+            const float *rDown = image0.data + ( y < dimY-1 ? y+1 : y )*dimX;
+            float dyScale = ( y > 0 && y < dimY-1 ) ? 0.5f : 1.0f;
+            sampleBilinearRow( image1, 0, y, u + y*dimX, v + y*dimX, 1, warped.data, dimX, BORDER_CLAMP, inside.data );
+            for( int x = 0; x < dimX; x++ )
+            {
+                int i = y*dimX + x;
+                int xl = x > 0 ? x-1 : x;
+                int xr = x < dimX-1 ? x+1 : x;
+                float gx = ( r[xr] - r[xl] )/( xr - xl );
+                float gy = dyScale*( rDown[x] - rUp[x] );
+
+                float it = -gx*u[i] - gy*v[i];
+                if( inside[x] )
+                    it += warped[x] - r[x];
+
+                if( !mismatchOnly )
+                {
+                    Ix2[i] = gx*gx;
+                    IxIy[i] = gx*gy;
+                    Iy2[i] = gy*gy;
+                }
+                IxIt[i] = gx*it;
+                IyIt[i] = gy*it;
+            }
+        }
+    }
+
+    if( radius == 0 )
+        return;
+    if( mismatchOnly )
+    {
+        // Filter only the last two channels
+        CImg<float> mismatch( IxIt, dimX, dimY, 1, 2, true );
+        BoxFilter( mismatch, radius );
+    }
+    else
+        BoxFilter( tensor, radius );
+}
+
+/**
+ * Lucas-Kanade solve of n consecutive pixels (see solveLucasKanade).
+ The test is a 0/1 float mask which blends the new and the old flow, so
+ that the loop has no control flow, and the channels are restrict
+ parameters: the loop vectorizes (at -O3, or at -O2 with OpenMP).
+ * @param Ix2 the channels of the structure tensor at the first pixel
+ * @param IxIy 
+ * @param Iy2 
+ * @param IxIt 
+ * @param IyIt 
+ * @param u the flow at the first pixel, updated
+ * @param v 
+ * @param n number of pixels
+ * @param minEigen threshold on the smallest eigenvalue of M
+ */
+inline void solveLucasKanadeRow( const float *__restrict Ix2, const float *__restrict IxIy,
+                                 const float *__restrict Iy2, const float *__restrict IxIt,
+                                 const float *__restrict IyIt, float *__restrict u, float *__restrict v,
+                                 int n, float minEigen )
+{
+#ifdef cimg_use_openmp
+#pragma omp simd
+#endif
+    for( int i = 0; i < n; i++ )
+    {
+        float a = Ix2[i], c = IxIy[i], d = Iy2[i];
+        // lambdaMin >= minEigen <=> t >= 0 and t*t >= diff*diff + c*c
+        float t = 0.5f*( a + d ) - minEigen;
+        float diff = 0.5f*( a - d );
+        float ok = (float)( ( t >= 0 ) & ( t*t >= diff*diff + c*c ) );
+        // det is replaced by 1 where the system is rejected, so that the
+        // blend below never multiplies an infinity by 0
+        float det = ok*( a*d - c*c ) + ( 1 - ok );
+        float invDet = 1.0f/det;
+        float newU = -invDet*( d*IxIt[i] - c*IyIt[i] );
+        float newV = -invDet*( a*IyIt[i] - c*IxIt[i] );
+        u[i] = ok*newU + ( 1 - ok )*u[i];
+        v[i] = ok*newV + ( 1 - ok )*v[i];
+    }
+}
+
+/**
+ * Solve the 2x2 systems M u = -b of Lucas-Kanade in closed form, and
+ replace the flow by their solution. Where the smallest eigenvalue of M is below minEigen the
+ flow is not changed. The rows are solved in parallel by solveLucasKanadeRow.
+ * @param tensor the structure tensor (see computeStructureTensor)
+ * @param flow the flow to update (2 slices)
+ * @param minEigen threshold on the smallest eigenvalue of M
+ */
+void solveLucasKanade( const CImg<float>& tensor, CImg<float>& flow, float minEigen )
+{
+    int dimX = tensor.dimx();
+    int dimY = tensor.dimy();
+    int pixelN = dimX*dimY;
+    const float *Ix2 = tensor.data, *IxIy = Ix2 + pixelN, *Iy2 = IxIy + pixelN;
+    const float *IxIt = Iy2 + pixelN, *IyIt = IxIt + pixelN;
+    float *u = flow.data, *v = flow.data + pixelN;
+
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int y = 0; y < dimY; y++ )
+    {
+        int row = y*dimX;
+        solveLucasKanadeRow( Ix2 + row, IxIy + row, Iy2 + row, IxIt + row, IyIt + row,
+                             u + row, v + row, dimX, minEigen );
+    }
+}
+
+/**
+ * Pyramidal Lucas-Kanade optical flow between two images.
+ At each level, from the coarsest to the finest, the flow of the previous
+ level is upsampled and refined iterationN times: the new flow solves
+ M u = -b, with M = W*[Ix2 IxIy; IxIy Iy2] and b = W*[IxIt; IyIt]
+ (W is a box window, see computeStructureTensor and solveLucasKanade).
+ Where the smallest eigenvalue of M is below minEigen (textureless
+ regions, edges) the flow of the coarser level is kept.
+ * @param pyramid0 gaussian pyramid of the first image (see buildPyramid)
+ * @param pyramid1 gaussian pyramid of the second image, same sizes
+ * @param flow result, flow(x,y,0) and flow(x,y,1) are the displacements
+ along x and y of the pixel (x,y) of image0: image1(x+u,y+v) = image0(x,y)
+ * @param iterationN number of warping iterations per level
+ * @param radius radius of the window
+ * @param minEigen threshold on the smallest eigenvalue of M
+ */
+void computeOpticalFlowLK( const CImgList<float>& pyramid0, const CImgList<float>& pyramid1, CImg<float>& flow,
+                           int iterationN = 3, int radius = 4, float minEigen = 1 )
+{
+    int levelN = pyramid0.size;
+    if( levelN == 0 || pyramid1.size != pyramid0.size )
+        throw EcpException( "computeOpticalFlowLK: the pyramids do not have the same number of levels" );
+    for( int level = 0; level < levelN; level++ )
+    {
+        if( pyramid0[level].dimx() != pyramid1[level].dimx() || pyramid0[level].dimy() != pyramid1[level].dimy() )
+            throw EcpException( "computeOpticalFlowLK: the images do not have the same size" );
+    }
+
+    CImg<float> tensor;
+    for( int level = levelN-1; level >= 0; level-- )
+    {
+        const CImg<float>& I0 = pyramid0[level];
+        const CImg<float>& I1 = pyramid1[level];
+
+        if( level == levelN-1 )
+        {
+            flow.assign( I0.dimx(), I0.dimy(), 2 );
+            flow.fill( 0 );
+        }
+        else
+            flow = upsampleOptFlow( flow, I0.dimx(), I0.dimy() );
+
+        for( int iteration = 0; iteration < iterationN; iteration++ )
+        {
+            computeStructureTensor( I0, I1, flow, tensor, radius, iteration > 0 );
+            solveLucasKanade( tensor, flow, minEigen );
+        }
+    }
+}
+
+/**
+ * Same as the previous function, from the images: their pyramids are built first.
+ * @param image0 first image (grey-level values)
+ * @param image1 second image, same size
+ * @param flow result
+ * @param levelN number of levels of the pyramid
+ * @param iterationN number of warping iterations per level
+ * @param radius radius of the window
+ * @param minEigen threshold on the smallest eigenvalue of M
+ */
+void computeOpticalFlowLK( const CImg<float>& image0, const CImg<float>& image1, CImg<float>& flow,
+                           int levelN = 4, int iterationN = 3, int radius = 4, float minEigen = 1 )
+{
+    if( image0.dimx() != image1.dimx() || image0.dimy() != image1.dimy() )
+        throw EcpException( "computeOpticalFlowLK: the images do not have the same size" );
+
+    CImgList<float> pyramid0, pyramid1;
+    buildPyramid( image0, pyramid0, levelN );
+    buildPyramid( image1, pyramid1, levelN );
+    computeOpticalFlowLK( pyramid0, pyramid1, flow, iterationN, radius, minEigen );
+}
+
+/**
+ * Red-black SOR relaxation of the linear Horn-Schunck system
+ (a + alpha2*n) u + c v - alpha2*sum(u_q) = f1
+ c u + (d + alpha2*n) v - alpha2*sum(v_q) = f2
+ where the q are the n 4-neighbours of the pixel in the image.
+ Each relaxation solves the 2x2 system of a pixel with its neighbours
+ fixed: the pixels of one color of the checkerboard are independent,
+ and they are updated in parallel.
+ * @param coef a, c, d (channels 0, 1, 2, see computeStructureTensor)
+ * @param rhs f1, f2 (2 slices)
+ * @param flow u, v (2 slices), updated in place
+ * @param alpha2 weight of the smoothness term
+ * @param iterationN number of relaxations of each pixel
+ * @param omega relaxation factor, in ]0,2[ (1 for Gauss-Seidel)
+ */
+void relaxHornSchunck( const CImg<float>& coef, const CImg<float>& rhs, CImg<float>& flow,
+                       float alpha2, int iterationN, float omega = 1 )
+{
+    int dimX = flow.dimx();
+    int dimY = flow.dimy();
+    int pixelN = dimX*dimY;
+    const float *a = coef.data, *c = a + pixelN, *d = c + pixelN;
+    const float *f1 = rhs.data, *f2 = rhs.data + pixelN;
+    float *u = flow.data, *v = flow.data + pixelN;
+
+    for( int iteration = 0; iteration < iterationN; iteration++ )
+    {
+        for( int color = 0; color < 2; color++ )
+        {
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+            for( int y = 0; y < dimY; y++ )
+            {
+                for( int x = ( y + color ) % 2; x < dimX; x += 2 )
+                {
+                    int i = y*dimX + x;
+                    float n = 0, su = 0, sv = 0;
+                    if( x > 0 )      { n++; su += u[i-1];    sv += v[i-1]; }
+                    if( x < dimX-1 ) { n++; su += u[i+1];    sv += v[i+1]; }
+                    if( y > 0 )      { n++; su += u[i-dimX]; sv += v[i-dimX]; }
+                    if( y < dimY-1 ) { n++; su += u[i+dimX]; sv += v[i+dimX]; }
+                    float a11 = a[i] + alpha2*n;
+                    float a22 = d[i] + alpha2*n;
+                    float r1 = f1[i] + alpha2*su;
+                    float r2 = f2[i] + alpha2*sv;
+                    float invDet = 1.0f/( a11*a22 - c[i]*c[i] );
+                    u[i] += omega*( invDet*( a22*r1 - c[i]*r2 ) - u[i] );
+                    v[i] += omega*( invDet*( a11*r2 - c[i]*r1 ) - v[i] );
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Residual of the linear Horn-Schunck system (see relaxHornSchunck).
+ * @param coef a, c, d
+ * @param rhs f1, f2
+ * @param flow u, v
+ * @param alpha2 weight of the smoothness term
+ * @param res result, rhs - A*flow (2 slices)
+ */
+void residualHornSchunck( const CImg<float>& coef, const CImg<float>& rhs, const CImg<float>& flow,
+                          float alpha2, CImg<float>& res )
+{
+    int dimX = flow.dimx();
+    int dimY = flow.dimy();
+    int pixelN = dimX*dimY;
+    const float *a = coef.data, *c = a + pixelN, *d = c + pixelN;
+    const float *f1 = rhs.data, *f2 = rhs.data + pixelN;
+    const float *u = flow.data, *v = flow.data + pixelN;
+    res.assign( dimX, dimY, 2 );
+    float *r1 = res.data, *r2 = res.data + pixelN;
+
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int y = 0; y < dimY; y++ )
+    {
+        for( int x = 0; x < dimX; x++ )
+        {
+            int i = y*dimX + x;
+            float n = 0, su = 0, sv = 0;
+            if( x > 0 )      { n++; su += u[i-1];    sv += v[i-1]; }
+            if( x < dimX-1 ) { n++; su += u[i+1];    sv += v[i+1]; }
+            if( y > 0 )      { n++; su += u[i-dimX]; sv += v[i-dimX]; }
+            if( y < dimY-1 ) { n++; su += u[i+dimX]; sv += v[i+dimX]; }
+            r1[i] = f1[i] - ( ( a[i] + alpha2*n )*u[i] + c[i]*v[i] - alpha2*su );
+            r2[i] = f2[i] - ( c[i]*u[i] + ( d[i] + alpha2*n )*v[i] - alpha2*sv );
+        }
+    }
+}
+
+/**
+ * Restriction of an image to the next coarser level of a pyramid
+ (see buildPyramid) with the full weighting [1/4 1/2 1/4] x [1/4 1/2 1/4]
+ centred on the pixel (2x,2y). All the slices and channels are restricted.
+ * @param fine input image
+ * @param coarse result, ((dimX+1)/2) x ((dimY+1)/2), same number of planes
+ */
+void restrictFullWeighting( const CImg<float>& fine, CImg<float>& coarse )
+{
+    int dimX = fine.dimx();
+    int dimY = fine.dimy();
+    int cX = ( dimX+1 )/2;
+    int cY = ( dimY+1 )/2;
+    int planeN = fine.dimz()*fine.dimv();
+    coarse.assign( cX, cY, fine.dimz(), fine.dimv() );
+
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+    for( int r = 0; r < planeN*cY; r++ )
+    {
+        int p = r / cY, y = r % cY;
+        const float *plane = fine.data + p*dimX*dimY;
+        const float *rows[3];
+        rows[0] = plane + ( 2*y > 0 ? 2*y-1 : 0 )*dimX;
+        rows[1] = plane + 2*y*dimX;
+        rows[2] = plane + ( 2*y+1 < dimY ? 2*y+1 : 2*y )*dimX;
+        float *out = coarse.data + r*cX;
+        for( int x = 0; x < cX; x++ )
+        {
+            int xl = 2*x > 0 ? 2*x-1 : 0;
+            int xr = 2*x+1 < dimX ? 2*x+1 : 2*x;
+            float s = 0;
+            for( int j = 0; j < 3; j++ )
+                s += ( j == 1 ? 0.5f : 0.25f )*( 0.25f*rows[j][xl] + 0.5f*rows[j][2*x] + 0.25f*rows[j][xr] );
+            out[x] = s;
+        }
+    }
+}
+
+/**
+ * One multigrid V-cycle on the linear Horn-Schunck system: relaxation,
+ restriction of the residual to the coarser grid, V-cycle on the error,
+ bilinear prolongation of the error and relaxation again.
+ The smoothness term of a grid twice coarser is alpha2/4.
+ * @param coefs the coefficients of each grid, from the finest to the coarsest
+ (coefs[g+1] is restrictFullWeighting(coefs[g]))
+ * @param rhs the right hand sides of each grid, only rhs[level] is used as input
+ * @param flows the solutions of each grid, flows[level] is updated in place
+ * @param level the grid of the cycle
+ * @param alpha2 weight of the smoothness term on this grid
+ */
+void vCycleHornSchunck( const CImgList<float>& coefs, CImgList<float>& rhs, CImgList<float>& flows,
+                        int level, float alpha2 )
+{
+    const int smoothN = 2;
+    CImg<float>& flow = flows[level];
+    if( level == (int)coefs.size-1 )
+    {
+        // the coarsest grid is small, it is solved by relaxation
+        relaxHornSchunck( coefs[level], rhs[level], flow, alpha2, 20, 1.5f );
+        return;
+    }
+
+    relaxHornSchunck( coefs[level], rhs[level], flow, alpha2, smoothN );
+
+    CImg<float> res;
+    residualHornSchunck( coefs[level], rhs[level], flow, alpha2, res );
+    restrictFullWeighting( res, rhs[level+1] );
+    flows[level+1].assign( rhs[level+1].dimx(), rhs[level+1].dimy(), 2 );
+    flows[level+1].fill( 0 );
+    vCycleHornSchunck( coefs, rhs, flows, level+1, alpha2/4 );
+
+    // the error is not a flow of the coarse grid: its values are not scaled
+    CImg<float> error = upsampleOptFlow( flows[level+1], flow.dimx(), flow.dimy() );
+    error *= 0.5f;
+    flow += error;
+
+    relaxHornSchunck( coefs[level], rhs[level], flow, alpha2, smoothN );
+}
+
+/**
+ * Pyramidal Horn-Schunck optical flow between two images.
+ The flow minimizes sum( (Ix u + Iy v + It)^2 + alpha^2 (|grad u|^2 + |grad v|^2) ),
+ so that the flow of the textureless regions is filled in from their
+ borders. As in computeOpticalFlowLK, the flow of each level of the
+ pyramid is upsampled to the next one, and refined iterationN times by
+ linearizing the second image around the current flow (the derivatives
+ and products are those of computeStructureTensor, without window).
+ Each linear system is solved with cycleN multigrid V-cycles
+ (vCycleHornSchunck), initialized with the current flow.
+ * @param pyramid0 gaussian pyramid of the first image (see buildPyramid)
+ * @param pyramid1 gaussian pyramid of the second image, same sizes
+ * @param flow result, same layout as in computeOpticalFlowLK
+ * @param iterationN number of warping iterations per level
+ * @param alpha weight of the smoothness term (in grey levels)
+ * @param cycleN number of V-cycles per iteration
+ */
+void computeOpticalFlowHS( const CImgList<float>& pyramid0, const CImgList<float>& pyramid1, CImg<float>& flow,
+                           int iterationN = 3, float alpha = 15, int cycleN = 2 )
+{
+    int levelN = pyramid0.size;
+    if( levelN == 0 || pyramid1.size != pyramid0.size )
+        throw EcpException( "computeOpticalFlowHS: the pyramids do not have the same number of levels" );
+    for( int level = 0; level < levelN; level++ )
+    {
+        if( pyramid0[level].dimx() != pyramid1[level].dimx() || pyramid0[level].dimy() != pyramid1[level].dimy() )
+            throw EcpException( "computeOpticalFlowHS: the images do not have the same size" );
+    }
+
+    CImg<float> tensor;
+    CImgList<float> coefs, rhs, flows;
+    for( int level = levelN-1; level >= 0; level-- )
+    {
+        const CImg<float>& I0 = pyramid0[level];
+        const CImg<float>& I1 = pyramid1[level];
+        int dimX = I0.dimx();
+        int dimY = I0.dimy();
+        int pixelN = dimX*dimY;
+
+        if( level == levelN-1 )
+        {
+            flow.assign( dimX, dimY, 2 );
+            flow.fill( 0 );
+        }
+        else
+            flow = upsampleOptFlow( flow, dimX, dimY );
+
+        // number of grids of the multigrid solver, down to about 8x8 pixels
+        int gridN = 1;
+        for( int x = dimX, y = dimY; x >= 16 && y >= 16; x = ( x+1 )/2, y = ( y+1 )/2 )
+            gridN++;
+        coefs.assign( gridN );
+        rhs.assign( gridN );
+        flows.assign( gridN );
+
+        for( int iteration = 0; iteration < iterationN; iteration++ )
+        {
+            // the pointwise products give the coefficients (a, c, d)
+            // and the right hand side -(IxIt, IyIt) of the finest grid
+            computeStructureTensor( I0, I1, flow, tensor, 0, iteration > 0 );
+            if( iteration == 0 )
+            {
+                coefs[0].assign( tensor.data, dimX, dimY, 1, 3 );
+                for( int g = 1; g < gridN; g++ )
+                    restrictFullWeighting( coefs[g-1], coefs[g] );
+            }
+            rhs[0].assign( tensor.data + 3*pixelN, dimX, dimY, 2 );
+            rhs[0] *= -1;
+
+            flows[0] = flow;
+            for( int cycle = 0; cycle < cycleN; cycle++ )
+                vCycleHornSchunck( coefs, rhs, flows, 0, alpha*alpha );
+            flow = flows[0];
+        }
+    }
+}
+
+/**
+ * Optical flow methods of computeOpticalFlow.
+ */
+enum FlowMethod
+{
+    FLOW_LUCAS_KANADE,  // local, see computeOpticalFlowLK
+    FLOW_HORN_SCHUNCK   // global, see computeOpticalFlowHS
+};
+
+#ifdef cimg_use_openmp
+/**
+ * Optical flow of a sequence with OpenMP tasks (see computeOpticalFlow).
+ The pyramid of each frame is a task, and the flow of each pair is a task
+ which depends on the pyramids of its two frames. The pyramids are stored
+ in a ring of 2*threads+2 slots: the pyramid of frame i+slotN waits until
+ the pairs which read the pyramid of frame i are done, so that the memory
+ does not grow with the length of the sequence. optFlow[i] is always the
+ flow of the pair (i,i+1), whatever the order in which the tasks run.
+ The parallel loops of the pairs run on one thread inside the tasks.
+ * @param images as in computeOpticalFlow
+ * @param optFlow as in computeOpticalFlow, with the right size
+ */
+void computeOpticalFlowTasks( const CImgList<float>& images, CImgList<float>& optFlow,
+                              int levelN, int iterationN, int radius, FlowMethod method, float alpha )
+{
+    int imageN = images.size;
+    int slotN = 2*omp_get_max_threads() + 2;
+    std::vector< CImgList<float> > ringStorage( slotN );
+    CImgList<float> *ring = &ringStorage[0];
+    double t = cimg::time();
+
+#pragma omp parallel
+#pragma omp single
+    for( int i = 0; i < imageN; i++ )
+    {
+        int slot = i % slotN;
+        int previous = ( i+slotN-1 ) % slotN;
+
+#pragma omp task depend(out: ring[slot])
+        buildPyramid( images[i], ring[slot], levelN );
+
+        if( i > 0 )
+        {
+#pragma omp task depend(in: ring[previous], ring[slot])
+            {
+                if( method == FLOW_HORN_SCHUNCK )
+                    computeOpticalFlowHS( ring[previous], ring[slot], optFlow[i-1], iterationN, alpha );
+                else
+                    computeOpticalFlowLK( ring[previous], ring[slot], optFlow[i-1], iterationN, radius );
+            }
+        }
+    }
+
+    cout << "-----> " << imageN-1 << " pairs on " << omp_get_max_threads() << " threads: "
+         << cimg::time() - t << " ms" << endl;
+}
+#endif
+
+/**
+ * Compute the optical flow in a sequence of images,
+ with the pyramidal Lucas-Kanade method (see computeOpticalFlowLK)
+ or the pyramidal Horn-Schunck method (see computeOpticalFlowHS).
+ Frame i is the second image of the pair (i-1,i) and the first one of the
+ pair (i,i+1): the pyramids are kept in a ring of two slots, so that the
+ pyramid of each frame is built once.
+ With OpenMP, when there are at least as many pairs as threads, the
+ pyramids and the pairs are OpenMP tasks scheduled by the runtime (see
+ computeOpticalFlowTasks). Otherwise the pairs are processed one after the
+ other, and the rows of each pair are shared by the threads.
  * @param images The images have to be gray-level values images
- * @param optFlow if this does not have the right size then it will be resized
+ * @param optFlow if this does not have the right size then it will be resized.
+ optFlow[i] is the flow from images[i] to images[i+1].
+ * @param levelN number of levels of the gaussian pyramid
+ * @param iterationN number of warping iterations per level
+ * @param radius radius of the window of Lucas-Kanade
+ * @param method FLOW_LUCAS_KANADE or FLOW_HORN_SCHUNCK
+ * @param alpha weight of the smoothness term of Horn-Schunck
  */
-void computeOpticalFlow( const CImgList<float>& images, CImgList<float>& optFlow )
+void computeOpticalFlow( const CImgList<float>& images, CImgList<float>& optFlow,
+                         int levelN = 4, int iterationN = 3, int radius = 4,
+                         FlowMethod method = FLOW_LUCAS_KANADE, float alpha = 15 )
 {
     //////////////////////////////
     // Check validity of arguments
@@ -283,32 +1278,79 @@ void computeOpticalFlow( const CImgList<float>& images, CImgList<float>& optFlow
     ///////////////////////
     cout << "----------> Compute the optical flow" << endl;
 	
-	// Initialize derivative images
-    CImg<float> Ix( dimX, dimY );
-    CImg<float> Ix2( dimX, dimY );
-    CImg<float> Iy( dimX, dimY );
-    CImg<float> Iy2( dimX, dimY );
-    CImg<float> IxIy( dimX, dimY );
-    CImg<float> It( dimX, dimY );
-    CImg<float> IxIt( dimX, dimY );
-    CImg<float> IyIt( dimX, dimY );
-	
-    // Derivation filters
-    CImg<float> maskX( 3, 1 );
-    // TODO
+#ifdef cimg_use_openmp
+    if( omp_get_max_threads() > 1 && imageN-1 >= omp_get_max_threads() )
+    {
+        computeOpticalFlowTasks( images, optFlow, levelN, iterationN, radius, method, alpha );
+        return;
+    }
+#endif
 
-    CImg<float> maskY( 1, 3 );
-    // TODO
+    // pyramids[i%2] is the pyramid of frame i
+    CImgList<float> pyramids[2];
+    buildPyramid( images[0], pyramids[0], levelN );
+    for( int i = 0; i < imageN-1; i++ )
+    {
+        double t = cimg::time();
+        buildPyramid( images[i+1], pyramids[(i+1)%2], levelN );
+        if( method == FLOW_HORN_SCHUNCK )
+            computeOpticalFlowHS( pyramids[i%2], pyramids[(i+1)%2], optFlow[i], iterationN, alpha );
+        else
+            computeOpticalFlowLK( pyramids[i%2], pyramids[(i+1)%2], optFlow[i], iterationN, radius );
+        cout << "-----> Images " << i << " and " << i+1 << ": " << cimg::time() - t << " ms" << endl;
+    }
+}
+
+/**
+ * Same as the previous function, with the frames of an ImageSequenceReader:
+ the flow of a pair is computed while the next frames are being decoded,
+ and only the pyramids of two frames are kept in memory.
+ Color frames are converted to grey-level values (mean of the channels),
+ use a reader created with grey = true to decode them directly in grey.
+ * @param reader the sequence
+ * @param optFlow the flows of the pairs (the list is emptied first)
+ * @param levelN as in the previous function
+ * @param iterationN 
+ * @param radius 
+ * @param method 
+ * @param alpha 
+ */
+void computeOpticalFlow( ImageSequenceReader& reader, CImgList<float>& optFlow,
+                         int levelN = 4, int iterationN = 3, int radius = 4,
+                         FlowMethod method = FLOW_LUCAS_KANADE, float alpha = 15 )
+{
+    cout << "----------> Compute the optical flow" << endl;
+    optFlow.assign();
+
+    CImg<float> frame, grey;
+    CImgList<float> pyramids[2];
+    int i;
+    for( i = 0; reader.next( frame ); i++ )
+    {
+        double t = cimg::time();
+        if( frame.dimz() != 1 )
+            throw EcpException( "computeOpticalFlow: the input images should not have a z dimension" );
+        if( frame.dimv() == 1 )
+            grey.swap( frame );
+        else
+            greyFromColor( frame, grey );
+        if( i > 0 && ( grey.dimx() != pyramids[0][0].dimx() || grey.dimy() != pyramids[0][0].dimy() ) )
+            throw EcpException( "computeOpticalFlow: the input images do not have all the same size" );
 
-    // Gaussian kernel
-    int dimGaussianX = 11;
-    int dimGaussianY = 11;
-    float sigma = 4;
-    
-    // Initialize M matrix and b, u vectors
-    CImg<float> M( 2, 2 );
-    CImg<float> b( 1, 2 );
-    CImg<float> u( 1, 2 );	
+        // pyramids[i%2] is the pyramid of frame i
+        buildPyramid( grey, pyramids[i%2], levelN );
+        if( i == 0 )
+            continue;
+
+        optFlow.push_back( CImg<float>() );
+        if( method == FLOW_HORN_SCHUNCK )
+            computeOpticalFlowHS( pyramids[(i-1)%2], pyramids[i%2], optFlow.back(), iterationN, alpha );
+        else
+            computeOpticalFlowLK( pyramids[(i-1)%2], pyramids[i%2], optFlow.back(), iterationN, radius );
+        cout << "-----> Images " << i-1 << " and " << i << ": " << cimg::time() - t << " ms" << endl;
+    }
+    if( i < 2 )
+        throw EcpException( "computeOpticalFlow: not enough input images" );
 }
 
 /*!
@@ -370,20 +1412,19 @@ void GaussianFilter(CImg<float> &_out, const CImg<float> &_in, float _sigma)
 CImg<float> subSambleOptFlow(const CImg<float> &_in, int _level)
 {
     CImg<float> _out( (_in.dimx())*_level,(_in.dimy())*_level,_in.dimz());
-    for (int x=0; x<_out.dimx(); x++){
-        for (int y=0; y<_out.dimy(); y++)
-        {
-            if ( ( x % _level ) || ( y % _level) )
-            {
-                _out(x,y,0) = GetInterpolatedValue(_in,(float)x/(float)_level,(float)y/(float)_level,0);
-                _out(x,y,1) = GetInterpolatedValue(_in,(float)x/(float)_level,(float)y/(float)_level,1);
-            }
-            else
-            {
-                _out(x,y,0) = _in(x/_level,y/_level,0);
-                _out(x,y,1) = _in(x/_level,y/_level,1);
-            }
-        }}
+    int dimX = _out.dimx();
+    //	the pixel (x,y) is sampled at (x/_level,y/_level) of the input,
+    //	i.e. at (x,y) + (du[x],dv[x]) in the row y/_level
+    CImg<float> du( dimX ), dv( dimX );
+    for (int x=0; x<dimX; x++)
+        du[x] = (float)x/(float)_level - x;
+    for (int y=0; y<_out.dimy(); y++)
+    {
+        float fy = (float)y/(float)_level;
+        dv.fill( fy - (int)fy );
+        for (int z=0; z<2; z++)
+            sampleBilinearRow( _in, z, (int)fy, du.data, dv.data, 1, _out.data + (z*_out.dimy() + y)*dimX, dimX );
+    }
     return _out;
 }
 /*!
@@ -435,31 +1476,60 @@ float	GetInterpolatedValue(
 
 //Create a warped image given an image and the optical flow.
 //As base image we consider the oldest image of the pair.
-CImg<float> warpImage(const CImg<float>& base, const CImg<float>& optFlow)
+//The rows are warped in parallel, and the minimum and the maximum are
+//computed during the warp. If normalize is false the values are not scaled
+//into [0,255] (e.g. when the display normalizes the image itself).
+CImg<float> warpImage(const CImg<float>& base, const CImg<float>& optFlow, bool normalize = true)
 {
     int dimX = base.dimx();
     int dimY = base.dimy();
 
-    float new_x;
-    float new_y;
     CImg<float> warp_img(dimX, dimY);
 
-    for(int x = 0; x < dimX; x++)
+    //	each row is sampled at (x-u,y-v)
+    const float *u = optFlow.data;
+    const float *v = optFlow.data + dimX*dimY;
+    float mn = cimg::type<float>::max();
+    float mx = cimg::type<float>::min();
+#ifdef cimg_use_openmp
+#pragma omp parallel
+#endif
     {
+        float threadMin = cimg::type<float>::max();
+        float threadMax = cimg::type<float>::min();
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
         for(int y = 0; y < dimY; y++)
         {
-            new_x = x - optFlow(x,y,0);
-            new_y = y - optFlow(x,y,1);
-            warp_img(x,y) = GetInterpolatedValue(base, new_x, new_y, 0);
+            float *row = warp_img.data + y*dimX;
+            sampleBilinearRow(base, 0, y, u + y*dimX, v + y*dimX, -1, row, dimX);
+            for(int x = 0; x < dimX; x++)
+            {
+                threadMin = row[x] < threadMin ? row[x] : threadMin;
+                threadMax = row[x] > threadMax ? row[x] : threadMax;
+            }
+        }
+#ifdef cimg_use_openmp
+#pragma omp critical
+#endif
+        {
+            mn = threadMin < mn ? threadMin : mn;
+            mx = threadMax > mx ? threadMax : mx;
         }
     }
 
     //Scale the values of the image into the interval [0,255]
-    float mn = warp_img.min();
-    float mx = warp_img.max();
-    for(int x = 0; x < dimX; x++)
-        for(int y = 0; y < dimY; y++)
-            warp_img(x,y) = 255*(warp_img(x,y) - mn)/(mx - mn);
+    if(normalize && mx > mn)
+    {
+        const float scale = 255/(mx - mn);
+        const int pixelN = dimX*dimY;
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+        for(int i = 0; i < pixelN; i++)
+            warp_img.data[i] = scale*(warp_img.data[i] - mn);
+    }
 
     return warp_img;
 }
@@ -487,9 +1557,9 @@ void displayAndCompare2Images(const CImg<float>& imageRed, const CImg<float>& im
 
     CImgDisplay draw_disp(visuImage,"Images");
 	
-    // continue while window is not closed
+    // wait for the events until the window is closed
     while (!draw_disp.is_closed)
-        continue;
+        draw_disp.wait();
 }
 
 #endif
@@ -23,11 +23,14 @@ using namespace cimg_library;
 //#include <cmath> //mathematical functions (exponential)
 #include "math.h" //mathematical functions (exponential)
 #include <cfloat>
+#include <cstring>
 
 #include <iostream> //for input and output on command line
 
 #include <vector>
 
+#include <algorithm>
+
 #include <sstream>
 
 
@@ -159,9 +162,307 @@ CImg<float> GaborFilter(float sigma, float freq, float dir, CImg<float> &img)
 }
 
 
+/*!
+\brief number of threads used by the parallel loops (1 without OpenMP)
+*/
+inline int NumThreads()
+{
+#ifdef cimg_use_openmp
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/*!
+\brief index of the calling thread inside a parallel region (0 without OpenMP)
+*/
+inline int ThreadId()
+{
+#ifdef cimg_use_openmp
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+/*!
+\brief IEEE half precision number, only used to store features
+*/
+struct half
+{
+	unsigned short bits;
+};
+
+/*!
+\brief convert a float to the nearest half precision number
+(overflows to infinity, underflows to signed zero)
+*/
+inline half FloatToHalf(float value)
+{
+	unsigned int f;
+	std::memcpy( &f, &value, sizeof(f) );
+	unsigned int sign = (f >> 16) & 0x8000u;
+	int exponent = static_cast<int>( (f >> 23) & 0xFFu ) - 127 + 15;
+	unsigned int mantissa = f & 0x7FFFFFu;
+	half h;
+	if( ((f >> 23) & 0xFFu) == 0xFFu )
+		h.bits = static_cast<unsigned short>( sign | 0x7C00u | (mantissa ? 0x200u : 0u) );
+	else if( exponent >= 31 )
+		h.bits = static_cast<unsigned short>( sign | 0x7C00u );
+	else if( exponent <= 0 )
+	{
+		if( exponent < -10 )
+			h.bits = static_cast<unsigned short>( sign );
+		else
+		{
+			// subnormal half: shift the mantissa with its implicit bit, round to nearest
+			mantissa |= 0x800000u;
+			int shift = 14 - exponent;
+			unsigned int rounded = (mantissa + (1u << (shift - 1))) >> shift;
+			h.bits = static_cast<unsigned short>( sign | rounded );
+		}
+	}
+	else
+	{
+		// round to nearest, a carry in the mantissa correctly increments the exponent
+		unsigned int rounded = (static_cast<unsigned int>( exponent ) << 10) + ((mantissa + 0x1000u) >> 13);
+		h.bits = static_cast<unsigned short>( sign | (rounded >= 0x7C00u ? 0x7C00u : rounded) );
+	}
+	return h;
+}
+
+/*!
+\brief convert a half precision number to a float.
+The exponent and the mantissa of the half, moved to the place of those of a
+float, give the value times 2^-112 (subnormal halves included), so the
+conversion is a multiplication and has no branch: it vectorizes in the
+loops over the components.
+*/
+inline float HalfToFloat(half h)
+{
+	unsigned int magnitude = static_cast<unsigned int>( h.bits & 0x7FFFu ) << 13;
+	float value;
+	std::memcpy( &value, &magnitude, sizeof(value) );
+	value *= 5.192296858534828e+33f;	// 2^112
+	unsigned int f;
+	std::memcpy( &f, &value, sizeof(f) );
+	// infinities and NaNs keep their mantissa (masks rather than a branch)
+	unsigned int special = 0u - static_cast<unsigned int>( magnitude >= 0x0F800000u );
+	f = (f & ~special) | ((magnitude | 0x7F800000u) & special);
+	f |= static_cast<unsigned int>( h.bits & 0x8000u ) << 16;
+	std::memcpy( &value, &f, sizeof(value) );
+	return value;
+}
+
+//! value of a stored feature component, in the coded frame
+inline float ToFloat(float v) { return v; }
+inline float ToFloat(unsigned char v) { return v; }
+inline float ToFloat(unsigned short v) { return v; }
+inline float ToFloat(half v) { return HalfToFloat( v ); }
+
+
+/*!
+\brief code of a value already expressed in the coded frame
+*/
+template<typename T> inline T Encode(float v) { return static_cast<T>( v + 0.5f ); }
+template<> inline float Encode<float>(float v) { return v; }
+template<> inline half Encode<half>(float v) { return FloatToHalf( v ); }
+
+/*!
+\brief largest integer code of an affine quantization, 0 when the values are stored as is
+*/
+template<typename T> inline float QuantizationLevels() { return 0; }
+template<> inline float QuantizationLevels<unsigned char>() { return 255; }
+template<> inline float QuantizationLevels<unsigned short>() { return 65535; }
+
+
+/*!
+\brief feature vectors stored in a compact form, one point per row.
+Component d of a point is offset(d) + scale(d)*code, so the clustering
+can work in the coded frame and read the codes directly.
+T is float, unsigned char or unsigned short (affine quantization) or half.
+*/
+template<typename T>
+struct CompactFeatures
+{
+	CImg<T> data;		///< the codes, one point per row
+	CImg<float> scale;	///< scale of every component
+	CImg<float> offset;	///< offset of every component
+};
+
+
+/*!
+\brief encode the responses of a Gabor filter bank, point p=x*dimY+y having
+the component i+j*num_freqs equal to filtered[i][j](x,y) (the layout of the
+CImg<float>(num_freqs, num_directions) feature images). Integer codes use a
+per-component affine quantization over the range of the response, half and
+float codes are stored as is.
+\param filtered			the responses, filtered[frequency][direction]
+\param num_freqs		number of frequencies
+\param num_directions	number of directions
+\param features			the encoded features (output)
+*/
+template<typename T>
+void EncodeFeatures( CImg<float> **filtered, int num_freqs, int num_directions, CompactFeatures<T>& features )
+{
+	int dim = num_freqs*num_directions;
+	int dimX = filtered[0][0].dimx();
+	int dimY = filtered[0][0].dimy();
+	features.data.assign( dim, dimX*dimY );
+	features.scale.assign( dim, 1, 1, 1, 1 );
+	features.offset.assign( dim, 1, 1, 1, 0 );
+
+	for( int j = 0; j < num_directions; j++ )
+	{
+		for( int i = 0; i < num_freqs; i++ )
+		{
+			const CImg<float>& response = filtered[i][j];
+			int d = i + j*num_freqs;
+			float scale = 1, offset = 0;
+			if( QuantizationLevels<T>() > 0 )
+			{
+				offset = response.min();
+				float range = response.max() - offset;
+				if( range > 0 )
+					scale = range/QuantizationLevels<T>();
+			}
+			features.scale(d) = scale;
+			features.offset(d) = offset;
+
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+			for( int x = 0; x < dimX; x++ )
+				for( int y = 0; y < dimY; y++ )
+					features.data( d, x*dimY + y ) = Encode<T>( (response( x, y ) - offset)/scale );
+		}
+	}
+}
+
+
+/*!
+\brief weighted squared euclidean distance between a stored point and a
+center expressed in the coded frame: sum of w[d]*(a[d] - b[d])^2
+\param a	first component of the stored point
+\param b	first component of the center
+\param w	weight of every component (the squared scales)
+\param dim	number of components
+*/
+template<typename T>
+inline float SquaredDistance(const T *a, const float *b, const float *w, int dim)
+{
+	float dist = 0;
+#ifdef cimg_use_openmp
+#pragma omp simd reduction(+:dist)
+#endif
+	for( int d = 0; d < dim; d++ )
+	{
+		float diff = ToFloat( a[d] ) - b[d];
+		dist += w[d]*diff*diff;
+	}
+	return dist;
+}
+
+/*!
+\brief the components of a stored point as floats, in the coded frame
+\param point	first component of the stored point
+\param dim		number of components
+\param scratch	room for dim floats, used for the codes which are not floats
+\return the decoded point
+*/
+template<typename T>
+inline const float* DecodePoint(const T *point, int dim, float *scratch)
+{
+#ifdef cimg_use_openmp
+#pragma omp simd
+#endif
+	for( int d = 0; d < dim; d++ )
+		scratch[d] = ToFloat( point[d] );
+	return scratch;
+}
+inline const float* DecodePoint(const float *point, int, float *) { return point; }
+
+/*!
+\brief find the center closest to a feature vector. The point is decoded
+once, the distances to the centers are then computed on floats.
+\param point	first component of the stored point
+\param centers	the centers in the coded frame, one per row
+\param weights	weight of every component
+\param minDist	squared distance to the closest center (output)
+\param scratch	room for one point (centers.dimx() floats), one per thread
+\return the index of the closest center
+*/
+template<typename T>
+inline int ClosestCenter(const T *point, const CImg<float> &centers, const CImg<float> &weights, float &minDist, float *scratch)
+{
+	int dim = centers.dimx();
+	int argMin = 0;
+	const float *x = DecodePoint( point, dim, scratch );
+	minDist = SquaredDistance( x, centers.ptr( 0, 0 ), weights.ptr(), dim );
+	for( int c = 1; c < centers.dimy(); c++ )
+	{
+		float dist = SquaredDistance( x, centers.ptr( 0, c ), weights.ptr(), dim );
+		if( dist < minDist )
+		{
+			minDist = dist;
+			argMin = c;
+		}
+	}
+	return argMin;
+}
+
+/*!
+\brief copy a stored point in a row of centers, in the coded frame
+*/
+template<typename T>
+inline void CopyPoint( const CImg<T>& data, int p, CImg<float>& centers, int c )
+{
+	const T *point = data.ptr( 0, p );
+	float *center = centers.ptr( 0, c );
+	for( int d = 0; d < data.dimx(); d++ )
+		center[d] = ToFloat( point[d] );
+}
+
 
+/*!
+\brief pseudo random number in [0,1) computed from two integers
 
-void kMeans( const CImgList<float>& points, CImg<int>& pointsAssignment, CImgList<float>& centers, int centerN )
+Unlike cimg::rand() it has no hidden state, so it can be called from
+parallel loops and gives the same sequence whatever the number of threads.
+*/
+inline float HashUniform(unsigned int a, unsigned int b)
+{
+	unsigned int h = a*0x9E3779B1u ^ ( b + 0x7F4A7C15u + (a << 6) + (a >> 2) );
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return (h >> 8)*(1.0f/16777216.0f);
+}
+
+
+//! the ways the centers can be initialized
+enum KMeansSeeding
+{
+	SEED_MODULO,			///< point p assigned to center #p modulo centerN
+	SEED_KMEANSPP,			///< k-means++: centers drawn one by one with D^2 sampling
+	SEED_KMEANS_PARALLEL	///< k-means||: oversampled D^2 sampling in a few passes
+};
+
+
+/*!
+\brief check the arguments of the k-means functions and copy the points in a
+contiguous buffer, one point per row, so that the distance kernels run over
+consecutive floats
+\param points			the points to cluster
+\param pointsAssignment	resized to hold one label per point
+\param centers			resized to hold centerN centers
+\param centerN			number of centers
+\param features			the packed points, with unit scales (output)
+*/
+void PrepareKMeans( const CImgList<float>& points, CImg<int>& pointsAssignment, CImgList<float>& centers, int centerN, CompactFeatures<float>& features )
 {
 	//////////////////////////////////////////
 	// Check arguments all have the right size
@@ -169,6 +470,8 @@ void kMeans( const CImgList<float>& points, CImg<int>& pointsAssignment, CImgLis
 	int pointN = points.size;
 	if( pointN == 0 )
 		throw EcpException(" kMeans: how can I do k-means on an empty list of points?" );
+	if( centerN <= 0 || centerN > pointN )
+		throw EcpException(" kMeans: the number of centers must be between 1 and the number of points" );
 	int dimX = points[0].dimx();
 	int dimY = points[0].dimy();
 	int dimZ = points[0].dimz();
@@ -187,23 +490,348 @@ void kMeans( const CImgList<float>& points, CImg<int>& pointsAssignment, CImgLis
 	if( pointsAssignment.dimy() != pointN && pointsAssignment.dimx() != 1 )
 		pointsAssignment.resize( 1, pointN );
 
-	
-	////////////////////////////////////////////////
-	//TO DO
-	///////////////////////////////////////////////
-	
-	
-	
-	////////////////////////////////////////////////
-	// Initialize points assignment
-	// (for example point p assigned to center #p modulo centerN
-	////////////////////////////////////////////////
+	int dim = points[0].size();
+	features.data.assign( dim, pointN );
+	features.scale.assign( dim, 1, 1, 1, 1 );
+	features.offset.assign( dim, 1, 1, 1, 0 );
+	for( int p = 0; p < pointN; p++ )
+		std::memcpy( features.data.ptr( 0, p ), points[p].ptr(), dim*sizeof(float) );
+}
 
+/*!
+\brief check the arguments of the k-means functions on compact features
+*/
+template<typename T>
+void PrepareKMeans( const CompactFeatures<T>& features, CImg<int>& pointsAssignment, CImg<float>& centers, int centerN )
+{
+	int pointN = features.data.dimy();
+	int dim = features.data.dimx();
+	if( pointN == 0 )
+		throw EcpException(" kMeans: how can I do k-means on an empty list of points?" );
+	if( centerN <= 0 || centerN > pointN )
+		throw EcpException(" kMeans: the number of centers must be between 1 and the number of points" );
+	if( (int)features.scale.size() != dim || (int)features.offset.size() != dim )
+		throw EcpException(" kMeans: the scales and offsets do not match the features" );
+	centers.assign( dim, centerN );
+	if( (int)pointsAssignment.size() != pointN )
+		pointsAssignment.assign( 1, pointN );
+}
+
+
+/*!
+\brief assign every point to its closest center
+\param data				the points, one per row
+\param centersData		the centers in the coded frame, one per row
+\param weights			weight of every component
+\param pointsAssignment	the labels, updated in place
+\return the number of points whose label changed
+*/
+template<typename T>
+int AssignPoints( const CImg<T>& data, const CImg<float>& centersData, const CImg<float>& weights, CImg<int>& pointsAssignment )
+{
+	int pointN = data.dimy();
+	int moved = 0;
+#ifdef cimg_use_openmp
+#pragma omp parallel reduction(+:moved)
+#endif
+	{
+		std::vector<float> scratch( data.dimx() );
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
+		for( int p = 0; p < pointN; p++ )
+		{
+			float minDist;
+			int argMin = ClosestCenter( data.ptr( 0, p ), centersData, weights, minDist, &scratch[0] );
+			if( pointsAssignment(p) != argMin )
+			{
+				pointsAssignment(p) = argMin;
+				moved++;
+			}
+		}
+	}
+	return moved;
+}
+
+
+/*!
+\brief move every center to the mean of the points assigned to it.
+Every thread sums its own points in double precision, the partial
+results are merged once. An empty group keeps its previous center.
+\param data				the points, one per row
+\param pointsAssignment	the labels
+\param centersData		the centers in the coded frame, one per row, updated in place
+*/
+template<typename T>
+void UpdateCenters( const CImg<T>& data, const CImg<int>& pointsAssignment, CImg<float>& centersData )
+{
+	int dim = data.dimx();
+	int pointN = data.dimy();
+	int centerN = centersData.dimy();
+	int threadN = NumThreads();
+	CImg<double> partialSums( dim, centerN, threadN, 1, 0 );
+	CImg<int> partialSizes( centerN, threadN, 1, 1, 0 );
+
+#ifdef cimg_use_openmp
+#pragma omp parallel
+#endif
+	{
+		int t = ThreadId();
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
+		for( int p = 0; p < pointN; p++ )
+		{
+			int c = pointsAssignment(p);
+			double *sum = partialSums.ptr( 0, c, t );
+			const T *point = data.ptr( 0, p );
+			for( int d = 0; d < dim; d++ )
+				sum[d] += ToFloat( point[d] );
+			partialSizes( c, t ) += 1;
+		}
+	}
+
+	for( int c = 0; c < centerN; c++ )
+	{
+		int groupSize = 0;
+		for( int t = 0; t < threadN; t++ )
+			groupSize += partialSizes( c, t );
+		if( groupSize == 0 )
+			continue;
+		for( int d = 0; d < dim; d++ )
+		{
+			double sum = 0;
+			for( int t = 0; t < threadN; t++ )
+				sum += partialSums( d, c, t );
+			centersData( d, c ) = static_cast<float>( sum/groupSize );
+		}
+	}
+}
+
+
+/*!
+\brief draw an index with probability proportional to weight*minDist
+(D^2 sampling). If all the products are 0, the index is drawn uniformly.
+\param minDist	squared distance of every point to its closest center
+\param weights	weight of every point, or 0 for unit weights
+*/
+int SampleD2( const CImg<float>& minDist, const CImg<float>* weights )
+{
+	int pointN = minDist.size();
+	double total = 0;
+	for( int p = 0; p < pointN; p++ )
+		total += weights ? (*weights)(p)*minDist(p) : minDist(p);
+	if( total <= 0 )
+		return std::min( static_cast<int>( cimg::rand()*pointN ), pointN - 1 );
+
+	double r = cimg::rand()*total;
 	for( int p = 0; p < pointN; p++ )
 	{
-		pointsAssignment(p) = p % centerN;
+		r -= weights ? (*weights)(p)*minDist(p) : minDist(p);
+		if( r <= 0 )
+			return p;
 	}
-	
+	return pointN - 1;
+}
+
+
+/*!
+\brief update the squared distance of every point to its closest center
+after new centers were added
+\param data			the points, one per row
+\param newCenters	the centers added since the last update, one per row
+\param weights		weight of every component
+\param minDist		the squared distances, updated in place
+\return the sum of the squared distances
+*/
+template<typename T>
+double UpdateMinDist( const CImg<T>& data, const CImg<float>& newCenters, const CImg<float>& weights, CImg<float>& minDist )
+{
+	int pointN = data.dimy();
+	double cost = 0;
+#ifdef cimg_use_openmp
+#pragma omp parallel reduction(+:cost)
+#endif
+	{
+		std::vector<float> scratch( data.dimx() );
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
+		for( int p = 0; p < pointN; p++ )
+		{
+			float dist;
+			ClosestCenter( data.ptr( 0, p ), newCenters, weights, dist, &scratch[0] );
+			if( dist < minDist(p) )
+				minDist(p) = dist;
+			cost += minDist(p);
+		}
+	}
+	return cost;
+}
+
+
+/*!
+\brief k-means++ seeding: the first center is drawn uniformly, the next ones
+with D^2 sampling. Costs centerN passes over the data.
+\param data			the points, one per row
+\param weights		weight of every component
+\param pointWeights	weight of every point, or 0 for unit weights
+\param centersData	the centers in the coded frame, one per row (output)
+*/
+template<typename T>
+void KMeansPlusPlus( const CImg<T>& data, const CImg<float>& weights, const CImg<float>* pointWeights, CImg<float>& centersData )
+{
+	int pointN = data.dimy();
+	int centerN = centersData.dimy();
+	CImg<float> minDist( pointN, 1, 1, 1, FLT_MAX );
+	// the first draw is uniform (or proportional to the weights)
+	CImg<float> unit( pointN, 1, 1, 1, 1 );
+	int p = SampleD2( unit, pointWeights );
+	CImg<float> newCenter( data.dimx(), 1 );
+	for( int c = 0; c < centerN; c++ )
+	{
+		CopyPoint( data, p, centersData, c );
+		if( c + 1 < centerN )
+		{
+			CopyPoint( data, p, newCenter, 0 );
+			UpdateMinDist( data, newCenter, weights, minDist );
+			p = SampleD2( minDist, pointWeights );
+		}
+	}
+}
+
+
+/*!
+\brief k-means|| seeding (Bahmani et al.): a few passes sample about
+2*centerN candidates each with D^2 probabilities, the candidates are then
+weighted by the number of points closest to them and reduced to centerN
+centers with a weighted k-means++.
+\param data			the points, one per row
+\param weights		weight of every component
+\param centersData	the centers in the coded frame, one per row (output)
+*/
+template<typename T>
+void KMeansParallel( const CImg<T>& data, const CImg<float>& weights, CImg<float>& centersData )
+{
+	const int roundN = 5;
+	int dim = data.dimx();
+	int pointN = data.dimy();
+	int centerN = centersData.dimy();
+	float oversampling = 2.0f*centerN;
+	unsigned int seed = static_cast<unsigned int>( cimg::rand()*4294967295.0 );
+
+	CImg<float> minDist( pointN, 1, 1, 1, FLT_MAX );
+	CImg<unsigned char> chosen( pointN, 1, 1, 1, 0 );
+	std::vector<int> candidates;
+
+	int first = std::min( static_cast<int>( cimg::rand()*pointN ), pointN - 1 );
+	chosen(first) = 2;
+	candidates.push_back( first );
+	CImg<float> firstCenter( dim, 1 );
+	CopyPoint( data, first, firstCenter, 0 );
+	double cost = UpdateMinDist( data, firstCenter, weights, minDist );
+
+	for( int round = 0; round < roundN && cost > 0; round++ )
+	{
+		// every point is drawn independently, with a probability proportional to its cost
+#ifdef cimg_use_openmp
+#pragma omp parallel for
+#endif
+		for( int p = 0; p < pointN; p++ )
+			if( !chosen(p) && HashUniform( seed + round, p ) < oversampling*minDist(p)/cost )
+				chosen(p) = 1;
+
+		int previousN = candidates.size();
+		for( int p = 0; p < pointN; p++ )
+			if( chosen(p) == 1 )
+			{
+				chosen(p) = 2;
+				candidates.push_back( p );
+			}
+		int newN = candidates.size() - previousN;
+		if( newN == 0 )
+			continue;
+		CImg<float> newCenters( dim, newN );
+		for( int i = 0; i < newN; i++ )
+			CopyPoint( data, candidates[previousN + i], newCenters, i );
+		cost = UpdateMinDist( data, newCenters, weights, minDist );
+	}
+
+	int candidateN = candidates.size();
+	if( candidateN < centerN )
+	{
+		// not enough distinct candidates (e.g. many duplicated points)
+		KMeansPlusPlus( data, weights, 0, centersData );
+		return;
+	}
+
+	// weight every candidate by the number of points it is closest to
+	CImg<float> candidatesData( dim, candidateN );
+	for( int i = 0; i < candidateN; i++ )
+		CopyPoint( data, candidates[i], candidatesData, i );
+	CImg<int> closest( 1, pointN, 1, 1, 0 );
+	AssignPoints( data, candidatesData, weights, closest );
+	CImg<float> pointWeights( candidateN, 1, 1, 1, 0 );
+	for( int p = 0; p < pointN; p++ )
+		pointWeights( closest(p) ) += 1;
+
+	KMeansPlusPlus( candidatesData, weights, &pointWeights, centersData );
+}
+
+
+/*!
+\brief initialize the centers
+\param data				the points, one per row
+\param weights			weight of every component
+\param seeding			the initialization method
+\param centersData		the centers in the coded frame, one per row (output)
+\param pointsAssignment	scratch labels, used by SEED_MODULO
+*/
+template<typename T>
+void SeedCenters( const CImg<T>& data, const CImg<float>& weights, KMeansSeeding seeding, CImg<float>& centersData, CImg<int>& pointsAssignment )
+{
+	int pointN = data.dimy();
+	int centerN = centersData.dimy();
+	switch( seeding )
+	{
+	case SEED_MODULO:
+		for( int p = 0; p < pointN; p++ )
+			pointsAssignment(p) = p % centerN;
+		UpdateCenters( data, pointsAssignment, centersData );
+		break;
+	case SEED_KMEANSPP:
+		KMeansPlusPlus( data, weights, 0, centersData );
+		break;
+	case SEED_KMEANS_PARALLEL:
+		KMeansParallel( data, weights, centersData );
+		break;
+	}
+}
+
+
+/*!
+\brief Lloyd iterations until no point changes of group
+\param features			the points
+\param pointsAssignment	the labels (output)
+\param centersData		the centers, one per row (output)
+\param seeding			the initialization method
+*/
+template<typename T>
+void KMeansLoop( const CompactFeatures<T>& features, CImg<int>& pointsAssignment, CImg<float>& centersData, KMeansSeeding seeding )
+{
+	const CImg<T>& data = features.data;
+	int pointN = data.dimy();
+	int threadN = NumThreads();
+	// the distances are computed in the coded frame, weighted by the squared scales
+	CImg<float> weights = features.scale.get_sqr();
+
+	////////////////////////////////////////////////
+	// Initialize the centers, then points assignment
+	////////////////////////////////////////////////
+	centersData.fill( 0 );
+	SeedCenters( data, weights, seeding, centersData, pointsAssignment );
+	pointsAssignment.fill( -1 );
+	AssignPoints( data, centersData, weights, pointsAssignment );
 
 
 	/////////////////////
@@ -211,59 +839,189 @@ void kMeans( const CImgList<float>& points, CImg<int>& pointsAssignment, CImgLis
 	/////////////////////
 	bool converged = false;
 	int iter = 0;
+	unsigned long assignTime = 0; // ms, summed over the iterations: one pass is often below the resolution of cimg::time()
 
 	while( !converged )
 	{
 		iter++;
-		std::cout << "iteration : " << iter << std::endl;
 
 		/////////////////////////////
 		// Recompute centers position
 		/////////////////////////////
-		
-		CImg<int> groupsSize(centerN, 1, 1, 1, 0);
-		for( int p = 0; p < pointN; p++ )
-		{
-			int c = pointsAssignment(p);
-			centers[c] *= groupsSize(c); 
-			centers[c] += points[p];
-			centers[c] /= groupsSize(c) + 1;
-			groupsSize(c) += 1;
-		}
-	
+
+		UpdateCenters( data, pointsAssignment, centersData );
 
 
 		//////////////////////////////
 		// Recompute points assignment
 		//////////////////////////////
- 
-		float minDist;
-		float dist;
-		float argMin = 0;
-		converged = true;
-		for( int p = 0; p < pointN; p++ )
+
+		unsigned long start = cimg::time();
+		int moved = AssignPoints( data, centersData, weights, pointsAssignment );
+		assignTime += cimg::time() - start;
+		converged = ( moved == 0 );
+
+		std::cout << "iteration : " << iter << ", " << moved << " points moved" << std::endl;
+	}
+
+	if( assignTime > 0 )
+		std::cout << "assignment : " << (double)pointN*iter*1000.0/( (double)assignTime*threadN )
+			<< " points/sec/core (mean over " << iter << " iterations)" << std::endl;
+
+	// back from the coded frame
+	for( int c = 0; c < centersData.dimy(); c++ )
+		for( int d = 0; d < centersData.dimx(); d++ )
+			centersData( d, c ) = features.offset(d) + features.scale(d)*centersData( d, c );
+}
+
+
+/*!
+\brief mini-batch k-means (Sculley): the centers are updated from random
+batches of points with a per-center learning rate 1/(number of points seen),
+and the points are assigned once at the end. The number of passes over the
+data is fixed: the seeding, iterN*batchSize/pointN and the final assignment.
+\param features			the points
+\param pointsAssignment	the labels (output)
+\param centersData		the centers, one per row (output)
+\param batchSize		number of points drawn per iteration
+\param iterN			number of iterations
+\param seeding			the initialization method
+*/
+template<typename T>
+void MiniBatchLoop( const CompactFeatures<T>& features, CImg<int>& pointsAssignment, CImg<float>& centersData,
+				   int batchSize, int iterN, KMeansSeeding seeding )
+{
+	const CImg<T>& data = features.data;
+	int dim = data.dimx();
+	int pointN = data.dimy();
+	int centerN = centersData.dimy();
+	if( batchSize <= 0 )
+		throw EcpException(" miniBatchKMeans: the batch size must be positive" );
+	CImg<float> weights = features.scale.get_sqr();
+
+	centersData.fill( 0 );
+	SeedCenters( data, weights, seeding, centersData, pointsAssignment );
+
+	CImg<int> seen( centerN, 1, 1, 1, 0 );
+	CImg<int> batch( batchSize );
+	CImg<int> batchAssignment( batchSize );
+	for( int iter = 0; iter < iterN; iter++ )
+	{
+		for( int b = 0; b < batchSize; b++ )
+			batch(b) = std::min( static_cast<int>( cimg::rand()*pointN ), pointN - 1 );
+
+		// the assignment of the batch uses the centers of the previous iteration
+#ifdef cimg_use_openmp
+#pragma omp parallel
+#endif
 		{
-			for( int c = 0; c < centerN; c++ )
+			std::vector<float> scratch( dim );
+#ifdef cimg_use_openmp
+#pragma omp for
+#endif
+			for( int b = 0; b < batchSize; b++ )
 			{
-				dist = (centers[c] - points[p]).norm(2);
-				if( c == 0 )
-				{
-					minDist = dist;
-				}
-				else if( minDist > dist )
-				{
-					minDist = dist;
-					argMin = c;
-				}
+				float minDist;
+				batchAssignment(b) = ClosestCenter( data.ptr( 0, batch(b) ), centersData, weights, minDist, &scratch[0] );
 			}
-			converged = (pointsAssignment(p) == argMin) && converged;
-			pointsAssignment(p) = argMin;
-
-
 		}
 
+		for( int b = 0; b < batchSize; b++ )
+		{
+			int c = batchAssignment(b);
+			seen(c) += 1;
+			float eta = 1.0f/seen(c);
+			float *center = centersData.ptr( 0, c );
+			const T *point = data.ptr( 0, batch(b) );
+			for( int d = 0; d < dim; d++ )
+				center[d] += eta*( ToFloat( point[d] ) - center[d] );
+		}
 	}
-	
+
+	std::cout << "mini-batch k-means: " << iterN << " iterations of " << batchSize << " points" << std::endl;
+	pointsAssignment.fill( -1 );
+	AssignPoints( data, centersData, weights, pointsAssignment );
+
+	for( int c = 0; c < centerN; c++ )
+		for( int d = 0; d < dim; d++ )
+			centersData( d, c ) = features.offset(d) + features.scale(d)*centersData( d, c );
+}
+
+
+void kMeans( const CImgList<float>& points, CImg<int>& pointsAssignment, CImgList<float>& centers, int centerN,
+			KMeansSeeding seeding = SEED_KMEANSPP )
+{
+	CompactFeatures<float> features;
+	PrepareKMeans( points, pointsAssignment, centers, centerN, features );
+	int dim = features.data.dimx();
+	CImg<float> centersData( dim, centerN );
+	KMeansLoop( features, pointsAssignment, centersData, seeding );
+	for( int c = 0; c < centerN; c++ )
+		std::memcpy( centers[c].ptr(), centersData.ptr( 0, c ), dim*sizeof(float) );
+}
+
+/*!
+\brief k-means on compact features, the distances are computed on the codes
+\param features			the points
+\param pointsAssignment	the labels (output)
+\param centers			the centers, one per row (output)
+\param centerN			number of centers
+\param seeding			the initialization method
+*/
+template<typename T>
+void kMeans( const CompactFeatures<T>& features, CImg<int>& pointsAssignment, CImg<float>& centers, int centerN,
+			KMeansSeeding seeding = SEED_KMEANSPP )
+{
+	PrepareKMeans( features, pointsAssignment, centers, centerN );
+	KMeansLoop( features, pointsAssignment, centers, seeding );
+}
+
+
+void miniBatchKMeans( const CImgList<float>& points, CImg<int>& pointsAssignment, CImgList<float>& centers, int centerN,
+					 int batchSize, int iterN, KMeansSeeding seeding = SEED_KMEANS_PARALLEL )
+{
+	CompactFeatures<float> features;
+	PrepareKMeans( points, pointsAssignment, centers, centerN, features );
+	int dim = features.data.dimx();
+	CImg<float> centersData( dim, centerN );
+	MiniBatchLoop( features, pointsAssignment, centersData, batchSize, iterN, seeding );
+	for( int c = 0; c < centerN; c++ )
+		std::memcpy( centers[c].ptr(), centersData.ptr( 0, c ), dim*sizeof(float) );
+}
+
+/*!
+\brief mini-batch k-means on compact features, see the CImgList version
+*/
+template<typename T>
+void miniBatchKMeans( const CompactFeatures<T>& features, CImg<int>& pointsAssignment, CImg<float>& centers, int centerN,
+					 int batchSize, int iterN, KMeansSeeding seeding = SEED_KMEANS_PARALLEL )
+{
+	PrepareKMeans( features, pointsAssignment, centers, centerN );
+	MiniBatchLoop( features, pointsAssignment, centers, batchSize, iterN, seeding );
+}
+
+/*!
+\brief cluster the responses of a Gabor filter bank stored as compact features
+\param filtered			the responses, filtered[frequency][direction]
+\param num_freqs		number of frequencies
+\param num_directions	number of directions
+\param pointsAssignment	the labels, point p=x*dimY+y (output)
+\param K				number of clusters
+\param batchSize		size of the mini-batches, 0 for the standard k-means
+\param batchIterN		number of mini-batch iterations
+*/
+template<typename T>
+void ClusterGaborFeatures( CImg<float> **filtered, int num_freqs, int num_directions, CImg<int>& pointsAssignment,
+						  int K, int batchSize, int batchIterN )
+{
+	CompactFeatures<T> features;
+	EncodeFeatures( filtered, num_freqs, num_directions, features );
+	std::cout << "Features stored on " << features.data.size()*sizeof(T) << " bytes" << std::endl;
+	CImg<float> centers;
+	if( batchSize > 0 )
+		miniBatchKMeans( features, pointsAssignment, centers, K, batchSize, batchIterN );
+	else
+		kMeans( features, pointsAssignment, centers, K );
 }
 
 
@@ -290,6 +1048,22 @@ int main(int argc, char** argv)
 	std::cout << "Number of clusters: ";
 	std::cin >> K;
 
+	// batchSize > 0 selects the mini-batch k-means, meant for large images
+	int batchSize;
+	std::cout << "Mini-batch size (0 for the standard k-means): ";
+	std::cin >> batchSize;
+	int batchIterN = 0;
+	if( batchSize > 0 )
+	{
+		std::cout << "Number of mini-batch iterations: ";
+		std::cin >> batchIterN;
+	}
+
+	// the features can be stored as 8 or 16 bits codes, or half floats, to save memory
+	int storage;
+	std::cout << "Feature storage (0: float, 1: uint8, 2: uint16, 3: half): ";
+	std::cin >> storage;
+
 	// number of directions considered in the Gabor filter bank
 	int num_directions;
 	std::cout << "Number of directions: ";
@@ -367,42 +1141,43 @@ int main(int argc, char** argv)
 		std::cout<<"End computation of frequency "<< i+1<<" over "<< num_freqs <<std::endl;
 	}
 
-	// create the  CImgList<float> features for k-means and store the features from the array filtered
-	
-	////////////////////////////////////////////////
-		//TO DO
-	///////////////////////////////////////////////
-
+	// Perform k-means on the Gabor features
+	CImg<int> pointsAssignment(dimX*dimY);
 	int p = 0;
-	CImgList<float> features(dimX * dimY, num_freqs, num_directions);
-	for( int x = 0; x < dimX; x++ )
+	if( storage == 0 )
 	{
-		for( int y = 0; y < dimY; y++ )
+		// create the  CImgList<float> features for k-means and store the features from the array filtered
+		CImgList<float> features(dimX * dimY, num_freqs, num_directions);
+		for( int x = 0; x < dimX; x++ )
 		{
-			for( int i = 0; i < num_freqs; i++ )
+			for( int y = 0; y < dimY; y++ )
 			{
-				for( int j = 0; j < num_directions; j++ )
+				for( int i = 0; i < num_freqs; i++ )
 				{
-					features[p](i,j) = filtered[i][j](x,y);
+					for( int j = 0; j < num_directions; j++ )
+					{
+						features[p](i,j) = filtered[i][j](x,y);
+					}
 				}
+				p++;
 			}
-			p++;
 		}
-	}
 
+		CImgList<float> centers;
+		if( batchSize > 0 )
+			miniBatchKMeans( features, pointsAssignment, centers, K, batchSize, batchIterN );
+		else
+			kMeans( features, pointsAssignment, centers, K );
+	}
+	// the compact features are built directly from the filter responses
+	else if( storage == 1 )
+		ClusterGaborFeatures<unsigned char>( filtered, num_freqs, num_directions, pointsAssignment, K, batchSize, batchIterN );
+	else if( storage == 2 )
+		ClusterGaborFeatures<unsigned short>( filtered, num_freqs, num_directions, pointsAssignment, K, batchSize, batchIterN );
+	else
+		ClusterGaborFeatures<half>( filtered, num_freqs, num_directions, pointsAssignment, K, batchSize, batchIterN );
 
-	
-
-	// Perform k-means on the Gabor features
-	CImgList<float> centers;
-	CImg<int> pointsAssignment(dimX*dimY);
-	kMeans( features, pointsAssignment, centers , K );
-	
 
-	
-	
-	
-	
 	// display utility
 	float **colors = new float*[K];
 	for(int k=0;k<K;k++)